@@ -14,3 +14,18 @@ glm::mat4 Object::GetModelMatrix() {
     return model;
 }
 
+void Object::Release() {
+    if (!buffers.empty()) {
+        glDeleteBuffers((GLsizei)buffers.size(), buffers.data());
+        buffers.clear();
+    }
+    if (dataTexture != 0) {
+        glDeleteTextures(1, &dataTexture);
+        dataTexture = 0;
+    }
+    if (VAO != 0) {
+        glDeleteVertexArrays(1, &VAO);
+        VAO = 0;
+    }
+}
+
@@ -36,14 +36,20 @@ struct UniformApplier {
 
 class Object {
 public:
-    GLuint VAO;
-    GLuint VBO;
-    GLuint EBO;
+    GLuint VAO = 0;
+    GLuint VBO = 0;
+    GLuint EBO = 0;
     uint32_t vertexCount;
     GLenum drawMode;
     bool useIndices = true;
     std::vector<Uniform> uniforms;
 
+    // Program used by the viewport, and a buffer texture bound to unit 0 if set
+    std::string shaderName = "default";
+    GLuint dataTexture = 0;
+    // Buffers behind VAO and dataTexture, freed by Release
+    std::vector<GLuint> buffers;
+
     glm::vec3 position = {0.0f, 0.0f, 0.0f};
     glm::vec3 rotation = {0.0f, 0.0f, 0.0f}; 
     glm::vec3 scale    = {1.0f, 1.0f, 1.0f};
@@ -54,6 +60,9 @@ public:
     float lineWidth = 1.0f;
 
     glm::mat4 GetModelMatrix();
+    // Objects are copied around by value, so GL objects are only freed on
+    // request, by the owner that replaces them. Needs the GL context.
+    void Release();
 
     void setUniform(const std::string& name, const UniformValue& value) {
         for (auto& u : uniforms) {
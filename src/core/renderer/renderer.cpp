@@ -18,6 +18,23 @@ void main() {
 })", R"(#version 330 core
 out vec4 FragColor;
 uniform vec4 Color;
+void main() {
+    FragColor = Color;
+})");
+
+    // Toolpaths from GCodeQuantizer, each run texel holds origin X/Y, step and height
+    ShaderFactory::RegisterFromSource("gcode_quantized", R"(#version 330 core
+layout (location = 0) in uvec2 aCoord;
+layout (location = 1) in uint aRun;
+uniform mat4 u_CombinedMatrix;
+uniform samplerBuffer u_Runs;
+void main() {
+    vec4 run = texelFetch(u_Runs, int(aRun));
+    vec3 pos = vec3(run.x + float(aCoord.x) * run.z, run.w, run.y + float(aCoord.y) * run.z);
+    gl_Position = u_CombinedMatrix * vec4(pos, 1.0);
+})", R"(#version 330 core
+out vec4 FragColor;
+uniform vec4 Color;
 void main() {
     FragColor = Color;
 })");
@@ -106,6 +123,11 @@ void Renderer::DrawObject(const std::unique_ptr<Object>& obj, GLuint shaderProgr
         std::visit(UniformApplier{shaderProgram, uniform.name}, uniform.value);
     }
 
+    if(obj->dataTexture != 0) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_BUFFER, obj->dataTexture);
+    }
+
     glBindVertexArray(obj->VAO);
 
     if(obj->useIndices)
@@ -134,6 +156,10 @@ void Renderer::DrawObject(const std::unique_ptr<Object>& obj, GLuint shaderProgr
     }
 
     glBindVertexArray(0);
+
+    if(obj->dataTexture != 0) {
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
 }
 
 void Renderer::DrawEnd() {
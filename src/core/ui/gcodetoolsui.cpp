@@ -12,9 +12,11 @@ void GCodeTools::LoadFileAndSaveExtractedPathAsObject(){
     }
     GCodeModule gcode;
     
-    gcode.OpenFile(&file);
-    gcode.ExtractPointsAndPaths();
-    
+    if (!gcode.LoadFile(&file)) {
+        printf("Failed to load GCode file: %s\n", file.path);
+        return;
+    }
+
     printf("GCode Points: %zu, Paths: %zu\n", gcode.points.size(), gcode.paths.size());
     FilePath saveFile = FileModule::SaveFile();
     if (saveFile.path != nullptr) {
@@ -32,22 +34,60 @@ void GCodeTools::LoadFileIntoProject(Project* project){
     project->LoadGCode(&file);
 }
 
+void GCodeTools::FollowFileIntoProject(Project* project, std::atomic<bool>* stop){
+    FilePath file = FileModule::SelectFile();
+    if (file.path == nullptr) {
+        printf("No file selected.\n");
+        return;
+    }
+    printf("Following GCode file: %s\n", file.path);
+    project->FollowGCode(&file, *stop);
+}
+
 void GCodeTools::render() {
     ImGui::Begin("GCode Tools");
 
     RootUICtx* ctx = GetRootUIContext();
     Project* project = ctx->getProject();
+    bool following = project->IsFollowingGCode();
+    bool gcodeTask = project->IsGCodeTaskRunning();
+    project->UpdateFollowPreview();
+    // The module belongs to the following thread or the GCode task until it is done, and is read by mesh generation
+    bool busy = following || gcodeTask || project->IsGeneratingMesh() || project->IsGeneratingLayerPreview();
 
-    if(project->isProjectLoaded()){
+    if(following){
+        ImGui::Text("Following GCode file...");
+    } else if(gcodeTask){
+        ImGui::Text("Working on the GCode file...");
+    } else if(project->isProjectLoaded()){
         FilePath* currentFile = project->GetCurrentGCodeFilePath();
         if(currentFile != nullptr){
             ImGui::Text("Current GCode File: %s", currentFile->path);
+            ImGui::Text("Layers: %zu", project->GetGCodeModule().layerBoundaries.size());
+            ImGui::BeginDisabled(busy);
             if(ImGui::Button("Genrate Render Object from GCode")){
                 project->GenerateRenderObjectFromGCode();
             }
             if(ImGui::Button("Extract Gcode Layers")){
                     project->ExtractLayers();
             }
+            if(ImGui::Button("Benchmark GCode Lexer")){
+                std::thread(&Project::BenchmarkGCodeLexer, project).detach();
+            }
+
+            size_t indexedLayers = project->GetGCodeModule().layerIndex.size();
+            ImGui::Text("Indexed Layers: %zu", indexedLayers);
+            if(ImGui::Button("Build Layer Index")){
+                std::thread(&Project::BuildGCodeLayerIndex, project).detach();
+            }
+            if(indexedLayers > 0){
+                ImGui::InputInt("Layer", &selectedLayer);
+                selectedLayer = std::clamp(selectedLayer, 0, (int)indexedLayers - 1);
+                if(ImGui::Button("Load Single Layer")){
+                    std::thread(&Project::LoadGCodeLayer, project, (size_t)selectedLayer).detach();
+                }
+            }
+            ImGui::EndDisabled();
         } else {
             ImGui::Text("No GCode File Loaded.");
         }
@@ -55,11 +95,36 @@ void GCodeTools::render() {
         ImGui::Text("No Project Loaded.");
     }
 
+    ImGui::Separator();
+    ImGui::Text("GCode Loader Settings:");
+    ImGui::Checkbox("Parallel Parsing", &parallelParse);
+    ImGui::Checkbox("Streaming Parse (low memory)", &streamingParse);
+    ImGui::Checkbox("Use Toolpath Cache (.rgc)", &useCache);
+    ImGui::Checkbox("Quantized Render Vertices", &quantizeRender);
+
+    ImGui::BeginDisabled(busy);
     if(ImGui::Button("Load GCode File into Project")){
+        project->GetGCodeModule().parallelParse = parallelParse;
+        project->GetGCodeModule().streamingParse = streamingParse;
+        project->GetGCodeModule().useCache = useCache;
+        project->GetGCodeModule().quantizeRender = quantizeRender;
         //LoadFileIntoProject(project);
         std::thread(LoadFileIntoProject, project).detach();
     }
 
+    if(ImGui::Button("Follow GCode File While Writing")){
+        project->GetGCodeModule().useCache = useCache;
+        stopFollowing = false;
+        std::thread(FollowFileIntoProject, project, &stopFollowing).detach();
+    }
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    ImGui::BeginDisabled(!following);
+    if(ImGui::Button("Stop Following")){
+        stopFollowing = true;
+    }
+    ImGui::EndDisabled();
+
 
     if (ImGui::Button("Load GCode File and Extract Paths as OBJ")) {
         std::thread(LoadFileAndSaveExtractedPathAsObject).detach();
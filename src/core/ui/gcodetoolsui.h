@@ -1,13 +1,22 @@
 #pragma once
 #include <imgui.h>
+#include <atomic>
 
 #include "ui.h"
 
 class Project;
 
 class GCodeTools : public UI {
+    bool parallelParse = true;
+    bool streamingParse = false;
+    bool useCache = true;
+    bool quantizeRender = true;
+    int selectedLayer = 0;
+    std::atomic<bool> stopFollowing = false;
+
     static void LoadFileAndSaveExtractedPathAsObject();
     static void LoadFileIntoProject(Project* project);
+    static void FollowFileIntoProject(Project* project, std::atomic<bool>* stop);
 
     void render() override;
 public:
@@ -13,7 +13,15 @@ void ModelGenUI::render() {
     Project* project = ctx->getProject();
 
     bool projectLoaded = project->isProjectLoaded();
-    if(projectLoaded) {
+    project->UpdateMeshRenderObjects();
+    if(project->IsFollowingGCode()) {
+        ImGui::Text("Waiting for the followed GCode file to finish.");
+    } else if(project->IsGCodeTaskRunning()) {
+        ImGui::Text("Waiting for the GCode task to finish.");
+    } else if(projectLoaded) {
+        // Settings are read by the running jobs, they only change while none runs
+        bool generating = project->IsGeneratingMesh() || project->IsGeneratingLayerPreview();
+        ImGui::BeginDisabled(generating);
         if(ImGui::Button("Generate 3D Model from Layers")){
             LayerMapper& layerMapper = project->GetLayerMapper();
             layerMapper.Set2DNozzlePolygon(nozzleDiameter);
@@ -32,14 +40,42 @@ void ModelGenUI::render() {
                 layerMapper.nozzleQuality = LayerMapper::MEDIUM;
                 break;
             }
+            layerMapper.unionBackend = unionBackendIndex == 1 ? LayerMapper::UNION_FAST : LayerMapper::UNION_EXACT;
+            layerMapper.tile_large_layers = tile_large_layers;
+            layerMapper.bead_footprints = bead_footprints;
+            layerMapper.slab_shell = slab_shell;
             layerMapper.Nef_based = nef_based;
+            layerMapper.nef_memory_budget_mb = nef_memory_budget_mb;
+            layerMapper.nef_bytes_per_vertex = nef_bytes_per_vertex;
+            layerMapper.max_threads = max_threads;
+            layerMapper.dedup_layers = dedup_layers;
+            layerMapper.merge_layer_runs = merge_layer_runs;
             layerMapper.remesh_after_layers = remesh_after_layers;
+            layerMapper.simplify_paths = simplify_paths;
+            layerMapper.simplify_tolerance = simplify_tolerance;
             if(remesh_after_layers){
                 layerMapper.remesh_target_length = remesh_target_length;
                 layerMapper.remesh_edge_angle = remesh_edge_angle;
                 layerMapper.remesh_iterations = remesh_iterations;
             }
-            project->GenerateShellMesh(); 
+            std::thread(&Project::GenerateShellMesh, project).detach();
+        }
+        ImGui::EndDisabled();
+        if(project->IsGeneratingMesh()) {
+            ImGui::SameLine();
+            ImGui::Text("Generating...");
+        }
+
+        // Previews run with interactive priority, ahead of a model being generated
+        size_t layerCount = project->GetGCodeModule().layerBoundaries.size();
+        if(layerCount > 0) {
+            ImGui::InputInt("Preview Layer", &previewLayer);
+            previewLayer = std::clamp(previewLayer, 0, (int)layerCount - 1);
+            ImGui::BeginDisabled(project->IsGeneratingLayerPreview());
+            if(ImGui::Button("Preview Layer Mesh")){
+                std::thread(&Project::GenerateLayerPreview, project, (size_t)previewLayer).detach();
+            }
+            ImGui::EndDisabled();
         }
     } else {
         ImGui::Text("No Project Loaded.");
@@ -48,11 +84,31 @@ void ModelGenUI::render() {
     // LayerMapper Options
     ImGui::Separator();
     ImGui::Text("Layer Mapper Settings:");
-    ImGui::Checkbox("Use Nef-based Merging", &nef_based);
+    ImGui::Checkbox("Stacked Slab Shell", &slab_shell);
+    if(!slab_shell) {
+        ImGui::Checkbox("Use Nef-based Merging", &nef_based);
+        if(nef_based) {
+            ImGui::SliderInt("Nef Memory Budget (MB)", &nef_memory_budget_mb, 256, 65536);
+            ImGui::SliderInt("Nef Bytes per Vertex", &nef_bytes_per_vertex, 512, 16384);
+        }
+    }
+    ImGui::SliderInt("Max Threads (0 = all)", &max_threads, 0, (int)std::thread::hardware_concurrency());
     ImGui::SliderFloat("Nozzle Diameter", &nozzleDiameter, 0.1f, 1.0f);
     // Nozzle Quality Selection
     const char* qualityItems[] = { "Low", "Medium", "High" };
     ImGui::Combo("Nozzle Quality", &qualityIndex, qualityItems, IM_ARRAYSIZE(qualityItems));
+    const char* unionItems[] = { "Exact", "Fast (micron grid)" };
+    ImGui::Combo("Layer Union", &unionBackendIndex, unionItems, IM_ARRAYSIZE(unionItems));
+    ImGui::Checkbox("Tile Large Layers", &tile_large_layers);
+    if(unionBackendIndex == 1) {
+        ImGui::Checkbox("Bead Footprints", &bead_footprints);
+    }
+    ImGui::Checkbox("Reuse Identical Layers", &dedup_layers);
+    ImGui::Checkbox("Merge Layer Runs", &merge_layer_runs);
+    ImGui::Checkbox("Simplify Paths", &simplify_paths);
+    if(simplify_paths) {
+        ImGui::SliderFloat("Simplify Tolerance (x nozzle)", &simplify_tolerance, 0.01f, 0.25f);
+    }
     ImGui::Separator();
     ImGui::Checkbox("Remesh After Layer Merging", &remesh_after_layers);
     if(remesh_after_layers) {
@@ -104,6 +160,17 @@ ModelGenUI::ModelGenUI(RootUICtx* rootUICtx) : UI(rootUICtx) {
     
     qualityIndex = layerMapper.nozzleQuality;
     //nozzleDiameter = layerMapper.nozzle.diameter;
+    unionBackendIndex = layerMapper.unionBackend;
+    tile_large_layers = layerMapper.tile_large_layers;
+    bead_footprints = layerMapper.bead_footprints;
+    slab_shell = layerMapper.slab_shell;
     nef_based = layerMapper.Nef_based;
+    nef_memory_budget_mb = layerMapper.nef_memory_budget_mb;
+    nef_bytes_per_vertex = layerMapper.nef_bytes_per_vertex;
+    max_threads = layerMapper.max_threads;
+    dedup_layers = layerMapper.dedup_layers;
+    merge_layer_runs = layerMapper.merge_layer_runs;
+    simplify_paths = layerMapper.simplify_paths;
+    simplify_tolerance = layerMapper.simplify_tolerance;
     //remesh_after_layers = layerMapper.remesh_after_layers;
 }
\ No newline at end of file
@@ -9,11 +9,23 @@
 class ModelGenUI : public UI{
     float nozzleDiameter = 0.60f;
     int qualityIndex = 0;
+    int unionBackendIndex = 1;
+    bool tile_large_layers = true;
+    bool bead_footprints = true;
+    bool slab_shell = true;
     bool nef_based = false;
+    int nef_memory_budget_mb = 4096;
+    int nef_bytes_per_vertex = 4096;
+    int max_threads = 0;
+    bool dedup_layers = true;
+    bool merge_layer_runs = true;
     bool remesh_after_layers = false;
+    bool simplify_paths = true;
+    float simplify_tolerance = 0.05f;
     float remesh_target_length = 1.1f;
     float remesh_edge_angle = 45.0f;
     int remesh_iterations = 1;
+    int previewLayer = 0;
 
 
     float tetrahedral_cell_size        = 2.0;
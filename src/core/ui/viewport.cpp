@@ -99,7 +99,7 @@ void Viewport::render() {
     if(project != nullptr){
         if(project->HasGCodeRenderObject() != false){
             std::unique_ptr<Object>& gcodeObj = project->GetGCodeRenderObject();
-            renderer->DrawObject(gcodeObj, ShaderFactory::GetProgram("default"));
+            renderer->DrawObject(gcodeObj, ShaderFactory::GetProgram(gcodeObj->shaderName));
         }
         if(project->HasTetrahedralMeshGenerated() != false){
             std::unique_ptr<Object>& meshObj = project->GetTetrahedralMeshMeshRenderObject();
@@ -108,6 +108,10 @@ void Viewport::render() {
             std::unique_ptr<Object>& meshObj = project->GetMeshRenderObject();
             renderer->DrawObject(meshObj, ShaderFactory::GetProgram("default"), true);
         }
+        if(project->HasLayerPreview() != false){
+            std::unique_ptr<Object>& previewObj = project->GetLayerPreviewRenderObject();
+            renderer->DrawObject(previewObj, ShaderFactory::GetProgram("default"), true);
+        }
     }
 
     // Draw selected vertices if any
@@ -5,7 +5,7 @@ FilePath FileModule::SelectFile(){
     FILE *fop;
     FilePath fp;
 
-    fop = popen("zenity --file-selection --file-filter=*.gcode --title=\"Open File\"", "r");
+    fop = popen("zenity --file-selection --file-filter=\"G-code | *.gcode *.gcode.gz *.bgcode\" --title=\"Open File\"", "r");
 
     if (fop == NULL) {
         return fp;
@@ -0,0 +1,78 @@
+#include "filewatcher.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+FileWatcher::~FileWatcher(){
+    Close();
+}
+
+bool FileWatcher::Open(const char* path){
+    Close();
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd == -1 ||
+        inotify_add_watch(inotifyFd, path, IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF) == -1) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void FileWatcher::Close(){
+    if (inotifyFd != -1) {
+        close(inotifyFd);
+        inotifyFd = -1;
+    }
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+    offset = 0;
+    writerDone = false;
+}
+
+long FileWatcher::ReadAppended(std::string& out, size_t maxBytes){
+    size_t base = out.size();
+    out.resize(base + maxBytes);
+    ssize_t count = pread(fd, out.data() + base, maxBytes, (off_t)offset);
+    out.resize(base + (count > 0 ? (size_t)count : 0));
+    if (count > 0) {
+        offset += (uint64_t)count;
+    }
+    return (long)count;
+}
+
+bool FileWatcher::IsTruncated() const {
+    struct stat st;
+    return fstat(fd, &st) == 0 && (uint64_t)st.st_size < offset;
+}
+
+bool FileWatcher::Wait(int timeoutMs){
+    struct pollfd pfd = {inotifyFd, POLLIN, 0};
+    if (poll(&pfd, 1, timeoutMs) <= 0) {
+        return false;
+    }
+
+    // Drain every queued event, only the writer finishing matters here
+    alignas(struct inotify_event) char events[4096];
+    ssize_t length;
+    while ((length = read(inotifyFd, events, sizeof(events))) > 0) {
+        for (char* p = events; p < events + length; ) {
+            const struct inotify_event* event = (const struct inotify_event*)p;
+            if (event->mask & (IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                writerDone = true;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Reads a file that another process is still appending to. inotify wakes
+// the reader when bytes are added and tells when the writer is done.
+class FileWatcher{
+    int fd = -1;
+    int inotifyFd = -1;
+    uint64_t offset = 0;
+    bool writerDone = false;
+public:
+    FileWatcher() = default;
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    bool Open(const char* path);
+    void Close();
+
+    // Appends up to maxBytes of data written since the last read to out.
+    // Returns the number of bytes read, 0 when caught up and -1 on error.
+    long ReadAppended(std::string& out, size_t maxBytes);
+
+    // True if the file got shorter than what was already read
+    bool IsTruncated() const;
+    void Rewind() { offset = 0; }
+
+    // Blocks until the file changes or timeoutMs passes, false on timeout
+    bool Wait(int timeoutMs);
+
+    // Set once the writer closed, moved or deleted the file
+    bool IsWriterDone() const { return writerDone; }
+    uint64_t Offset() const { return offset; }
+};
@@ -0,0 +1,71 @@
+#include "gzipfile.h"
+
+#include <cstdio>
+#include <cstring>
+
+// Size of zlib's internal input and output buffers
+#define GZIP_BUFFER_SIZE (256 * 1024)
+
+GzipFile::~GzipFile(){
+    Close();
+}
+
+bool GzipFile::IsGzipPath(const char* path){
+    size_t length = strlen(path);
+    return length >= 3 && strcmp(path + length - 3, ".gz") == 0;
+}
+
+bool GzipFile::Open(const char* path){
+    Close();
+
+    file = gzopen(path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    gzbuffer(file, GZIP_BUFFER_SIZE);
+    return true;
+}
+
+void GzipFile::Close(){
+    if (file != nullptr) {
+        gzclose(file);
+        file = nullptr;
+    }
+    carry.clear();
+    failed = false;
+}
+
+bool GzipFile::NextChunk(std::string& chunk, size_t chunkSize){
+    chunk.swap(carry);
+    carry.clear();
+
+    while (file != nullptr) {
+        size_t filled = chunk.size();
+        if (filled >= chunkSize) {
+            // Keep the partial last line for the next chunk, a line longer
+            // than the chunk just makes the chunk grow
+            size_t lineEnd = chunk.rfind('\n');
+            if (lineEnd != std::string::npos) {
+                carry.assign(chunk, lineEnd + 1);
+                chunk.resize(lineEnd + 1);
+                break;
+            }
+        }
+
+        chunk.resize(filled + chunkSize);
+        int count = gzread(file, chunk.data() + filled, (unsigned)chunkSize);
+        chunk.resize(filled + (count > 0 ? (size_t)count : 0));
+        if (count <= 0) {
+            // A truncated archive ends with 0 bytes read and Z_BUF_ERROR set
+            int error = Z_OK;
+            const char* message = gzerror(file, &error);
+            if (count < 0 || error != Z_OK) {
+                printf("Failed to inflate gzip data: %s\n", message);
+                failed = true;
+            }
+            gzclose(file);
+            file = nullptr;
+        }
+    }
+    return !failed && !chunk.empty();
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+#include <zlib.h>
+
+// Streaming reader for gzip compressed text, inflated in blocks straight
+// from the compressed file without writing anything to disk.
+class GzipFile{
+    gzFile file = nullptr;
+    std::string carry;
+    bool failed = false;
+public:
+    GzipFile() = default;
+    ~GzipFile();
+
+    GzipFile(const GzipFile&) = delete;
+    GzipFile& operator=(const GzipFile&) = delete;
+
+    // True for paths ending in ".gz"
+    static bool IsGzipPath(const char* path);
+
+    bool Open(const char* path);
+    void Close();
+
+    // Replaces chunk with roughly chunkSize inflated bytes ending on a line
+    // boundary, the final chunk ends at the end of the data. Returns false
+    // once everything is consumed or the data is corrupt.
+    bool NextChunk(std::string& chunk, size_t chunkSize);
+
+    bool HasFailed() const { return failed; }
+};
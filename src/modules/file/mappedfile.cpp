@@ -0,0 +1,55 @@
+#include "mappedfile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::~MappedFile(){
+    Close();
+}
+
+bool MappedFile::Open(const char* path){
+    Close();
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        Close();
+        return false;
+    }
+
+    size = (size_t)st.st_size;
+    if (size == 0) {
+        // mmap rejects zero length mappings, an empty view is enough
+        return true;
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        Close();
+        return false;
+    }
+
+    // Loaders walk the file front to back
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    data = (const char*)mapping;
+    return true;
+}
+
+void MappedFile::Close(){
+    if (data != nullptr) {
+        munmap((void*)data, size);
+        data = nullptr;
+    }
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+    size = 0;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+
+// Read-only memory mapping of a whole file. The mapping lives as long as
+// the object, so string_views handed out by View() must not outlive it.
+class MappedFile{
+    int fd = -1;
+    const char* data = nullptr;
+    size_t size = 0;
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const char* path);
+    void Close();
+
+    bool IsOpen() const { return fd != -1; }
+    const char* Data() const { return data; }
+    size_t Size() const { return size; }
+    std::string_view View() const { return std::string_view(data, size); }
+};
@@ -1,125 +1,604 @@
 
 #include "gcode.h"
+#include "gcodereader.h"
+#include "gcodecache.h"
+#include "gcodequantizer.h"
+#include "gcodebinary.h"
 #include "../file/file.h"
+#include "../file/mappedfile.h"
+#include "../file/filewatcher.h"
+#include "../file/gzipfile.h"
 #include "../../core/renderer/object.h"
 
-void GCodeModule::OpenFile(FilePath *filepath)
+#include <tbb/parallel_pipeline.h>
+#include <tbb/parallel_for.h>
+#include <tbb/combinable.h>
+#include <tbb/info.h>
+
+#include <cmath>
+#include <chrono>
+
+bool GCodeModule::LoadFile(FilePath *filepath)
 {
-    FILE *file = fopen(filepath->path, "r");
-    if (file == nullptr)
+    if (useCache && GCodeCache::Load(filepath->path, *this))
     {
-        printf("Failed to open file: %s", filepath->path);
-        return;
+        SetCurrentFile(filepath);
+        programCommands.Clear();
+        ClearLayers();
+        printf("Loaded toolpaths from cache: %zu points, %zu paths\n", points.size(), paths.size());
+        return true;
     }
 
-    currentFile = std::make_unique<FilePath>();
-    *currentFile = *filepath;
-
-    programCommands.clear();
-    
-    while (!feof(file))
+    bool loaded;
+    if (GCodeBinaryReader::IsBinaryPath(filepath->path))
+    {
+        loaded = StreamBinaryFile(filepath);
+    }
+    else if (GzipFile::IsGzipPath(filepath->path))
+    {
+        loaded = StreamGzipFile(filepath);
+    }
+    else if (streamingParse)
+    {
+        loaded = StreamFile(filepath);
+    }
+    else
     {
-        long index = ftell(file);
-        char buffer[READER_BUFFER_SIZE];
-        bool comment = false;
-        bool program = false;
-        bool newLine = false;
-        char programBuffer[PROGRAM_BUFFER_SIZE];
-        int programBufferIndex = 0;
-        if (fgets(buffer, sizeof(buffer), file) != nullptr)
+        loaded = OpenFile(filepath);
+        if (loaded)
         {
-            for (int i = 0; buffer[i] != '\0'; i++)
-            {
-                // Process each character in the line
-                char c = buffer[i];
-                if (c == ';' && !comment)
+            ExtractPointsAndPaths();
+        }
+    }
+
+    // The toolpaths are either another file's or incomplete, they must not be
+    // cached under this file's key
+    if (!loaded)
+    {
+        return false;
+    }
+    BuildLayerBoundaries();
+
+    if (useCache)
+    {
+        GCodeCache::Save(filepath->path, *this);
+    }
+    return true;
+}
+
+bool GCodeModule::OpenFile(FilePath *filepath)
+{
+    MappedFile file;
+    if (!file.Open(filepath->path))
+    {
+        printf("Failed to open file: %s\n", filepath->path);
+        return false;
+    }
+
+    SetCurrentFile(filepath);
+
+    programCommands.Clear();
+
+    if (parallelParse)
+    {
+        GCodeReader::ParseTextParallel(file.View(), programCommands);
+    }
+    else
+    {
+        GCodeReader::ParseText(file.View(), programCommands);
+    }
+    return true;
+}
+
+bool GCodeModule::ParseGCodeLine(std::string_view line, GCodeCommandTable &table)
+{
+    return GCodeReader::ParseProgram(GCodeReader::ExtractProgram(line), table);
+}
+
+void GCodeModule::ExtractPointsAndPaths()
+{
+    ResetMachine();
+    ExecuteCommands(programCommands);
+}
+
+bool GCodeModule::StreamFile(FilePath *filepath)
+{
+    MappedFile file;
+    if (!file.Open(filepath->path))
+    {
+        printf("Failed to open file: %s\n", filepath->path);
+        return false;
+    }
+
+    SetCurrentFile(filepath);
+
+    programCommands.Clear();
+    ResetMachine();
+
+    // Chunks are parsed concurrently but interpreted strictly in file order,
+    // only the chunks in flight hold parsed commands at any time
+    std::string_view text = file.View();
+    size_t liveChunks = parallelParse ? (size_t)tbb::info::default_concurrency() * 2 : 1;
+
+    tbb::parallel_pipeline(liveChunks,
+        tbb::make_filter<void, std::string_view>(tbb::filter_mode::serial_in_order,
+            [&](tbb::flow_control& fc) -> std::string_view {
+                if (text.empty())
                 {
-                    comment = true;
+                    fc.stop();
+                    return std::string_view();
                 }
-                else if (comment && c == '\n')
+                return GCodeReader::NextChunk(text, STREAM_CHUNK_SIZE);
+            }) &
+        tbb::make_filter<std::string_view, GCodeCommandTable*>(tbb::filter_mode::parallel,
+            [](std::string_view chunk) -> GCodeCommandTable* {
+                GCodeCommandTable* table = new GCodeCommandTable();
+                GCodeReader::ParseText(chunk, *table);
+                return table;
+            }) &
+        tbb::make_filter<GCodeCommandTable*, void>(tbb::filter_mode::serial_in_order,
+            [&](GCodeCommandTable* table) {
+                ExecuteCommands(*table);
+                delete table;
+            })
+    );
+    return true;
+}
+
+bool GCodeModule::StreamGzipFile(FilePath *filepath)
+{
+    GzipFile file;
+    if (!file.Open(filepath->path))
+    {
+        printf("Failed to open file: %s\n", filepath->path);
+        return false;
+    }
+
+    SetCurrentFile(filepath);
+
+    programCommands.Clear();
+    ResetMachine();
+
+    // Same pipeline as StreamFile with inflation as its input stage, so
+    // inflating the next chunk overlaps with parsing and interpreting
+    size_t liveChunks = parallelParse ? (size_t)tbb::info::default_concurrency() * 2 : 2;
+
+    tbb::parallel_pipeline(liveChunks,
+        tbb::make_filter<void, std::string*>(tbb::filter_mode::serial_in_order,
+            [&](tbb::flow_control& fc) -> std::string* {
+                std::string* chunk = new std::string();
+                if (!file.NextChunk(*chunk, STREAM_CHUNK_SIZE))
                 {
-                    comment = false;
-                    continue;
+                    delete chunk;
+                    fc.stop();
+                    return nullptr;
                 }
-                else if (!comment)
+                return chunk;
+            }) &
+        tbb::make_filter<std::string*, GCodeCommandTable*>(tbb::filter_mode::parallel,
+            [](std::string* chunk) -> GCodeCommandTable* {
+                GCodeCommandTable* table = new GCodeCommandTable();
+                GCodeReader::ParseText(*chunk, *table);
+                delete chunk;
+                return table;
+            }) &
+        tbb::make_filter<GCodeCommandTable*, void>(tbb::filter_mode::serial_in_order,
+            [&](GCodeCommandTable* table) {
+                ExecuteCommands(*table);
+                delete table;
+            })
+    );
+
+    if (file.HasFailed())
+    {
+        printf("GCode archive is corrupt, loaded up to the damaged block: %s\n", filepath->path);
+        return false;
+    }
+    return true;
+}
+
+bool GCodeModule::StreamBinaryFile(FilePath *filepath)
+{
+    MappedFile file;
+    if (!file.Open(filepath->path))
+    {
+        printf("Failed to open file: %s\n", filepath->path);
+        return false;
+    }
+
+    std::string_view data = file.View();
+    BGCodeChecksum checksum;
+    if (!GCodeBinaryReader::ReadFileHeader(data, checksum))
+    {
+        printf("Not a binary GCode file: %s\n", filepath->path);
+        return false;
+    }
+
+    SetCurrentFile(filepath);
+
+    programCommands.Clear();
+    ResetMachine();
+
+    // Blocks are located serially, decoded concurrently and interpreted in
+    // file order. Metadata and thumbnail blocks are skipped.
+    std::atomic<bool> failed = false;
+    size_t liveBlocks = parallelParse ? (size_t)tbb::info::default_concurrency() * 2 : 1;
+
+    tbb::parallel_pipeline(liveBlocks,
+        tbb::make_filter<void, BGCodeBlock>(tbb::filter_mode::serial_in_order,
+            [&](tbb::flow_control& fc) -> BGCodeBlock {
+                BGCodeBlock block;
+                while (GCodeBinaryReader::NextBlock(data, checksum, block))
                 {
-                    if ((c == 'G' || c == 'M') && !program)
+                    if (block.type == BGCodeBlockType::GCODE)
                     {
-                        program = true;
-                        programBuffer[programBufferIndex++] = c;
-                    }
-                    else if (program)
-                    {
-                        if (c == '\n' || c == '\r')
-                        {
-                            programBuffer[programBufferIndex] = '\0';
-                            program = false;
-
-                            // printf("Program Buffer: %s\n", programBuffer);
-                            
-                            GCodeProgramCommand command = ParseGCodeLine(programBuffer);
-
-                            programCommands.push_back(command);
-
-                            /*printf("Extracted Command: %c-%d\n", command.command, command.id);
-                            printf("Arguments:\n");
-                            for (const auto &arg : command.arguments)
-                            {
-                                printf("  %c: %.2f\n", arg.letter, arg.value);
-                            }*/
-
-                            programBufferIndex = 0;
-                        }
-                        else
-                        {
-                            programBuffer[programBufferIndex++] = c;
-                        }
+                        return block;
                     }
                 }
+                if (!data.empty())
+                {
+                    failed = true;
+                }
+                fc.stop();
+                return BGCodeBlock();
+            }) &
+        tbb::make_filter<BGCodeBlock, GCodeCommandTable*>(tbb::filter_mode::parallel,
+            [&](const BGCodeBlock& block) -> GCodeCommandTable* {
+                GCodeCommandTable* table = new GCodeCommandTable();
+                if (!GCodeBinaryReader::DecodeGCodeBlock(block, *table))
+                {
+                    failed = true;
+                }
+                return table;
+            }) &
+        tbb::make_filter<GCodeCommandTable*, void>(tbb::filter_mode::serial_in_order,
+            [&](GCodeCommandTable* table) {
+                ExecuteCommands(*table);
+                delete table;
+            })
+    );
+
+    if (failed)
+    {
+        printf("Binary GCode file is damaged, some blocks were skipped: %s\n", filepath->path);
+        return false;
+    }
+    return true;
+}
+
+void GCodeModule::BenchmarkLexer()
+{
+    if (!currentFile)
+    {
+        printf("No GCode file loaded. Cannot benchmark lexer.\n");
+        return;
+    }
+    if (!IsPlainTextFile(currentFile->path, "Lexer benchmark"))
+    {
+        return;
+    }
+
+    MappedFile file;
+    if (!file.Open(currentFile->path))
+    {
+        printf("Failed to open file: %s\n", currentFile->path);
+        return;
+    }
+    GCodeReader::BenchmarkLexers(file.View());
+}
+
+bool GCodeModule::BuildLayerIndex(FilePath *filepath)
+{
+    if (!IsPlainTextFile(filepath->path, "Layer index"))
+    {
+        return false;
+    }
+
+    MappedFile file;
+    if (!file.Open(filepath->path))
+    {
+        printf("Failed to open file: %s\n", filepath->path);
+        return false;
+    }
+
+    SetCurrentFile(filepath);
+
+    // Scratch interpreter, its paths only tell whether a line extruded and
+    // are dropped right away so memory stays flat on any file size
+    GCodeModule machine;
+    GCodeCommandTable table;
+
+    // A layer starts at the earliest ;LAYER comment or Z change since the
+    // last extrusion. It is only committed once something is extruded at a
+    // new height, so Z hops that come back down do not split layers.
+    GCodeLayerIndexEntry pending = {0.0f, 0, GCodeMachineState()};
+    bool hasPending = true;
+
+    std::string_view text = file.View();
+    std::string_view remaining = text;
+    while (!remaining.empty())
+    {
+        uint64_t offset = (uint64_t)(remaining.data() - text.data());
+        std::string_view line = GCodeReader::NextLine(remaining);
+
+        if (!hasPending && GCodeReader::IsLayerComment(line))
+        {
+            pending = {0.0f, offset, machine.state};
+            hasPending = true;
+            continue;
+        }
+
+        std::string_view program = GCodeReader::ExtractProgram(line);
+        if (program.empty())
+        {
+            continue;
+        }
+
+        table.Reset();
+        if (!GCodeReader::ParseProgram(program, table))
+        {
+            continue;
+        }
+
+        GCodeMachineState before = machine.state;
+        machine.ExecuteCommands(table);
+
+        if (!hasPending && machine.state.globalPosition.y != before.globalPosition.y)
+        {
+            pending = {0.0f, offset, before};
+            hasPending = true;
+        }
+
+        if (!machine.paths.empty())
+        {
+            float z = machine.points[machine.paths.back().end - 1].y; // Height is stored on y
+            if (hasPending && (layerIndex.empty() || layerIndex.back().z != z))
+            {
+                pending.z = z;
+                layerIndex.push_back(pending);
             }
+            hasPending = false;
+            machine.points.clear();
+            machine.paths.clear();
+            machine.pathStates.clear();
         }
     }
 
-    fclose(file);
+    printf("Indexed %zu layers in %s\n", layerIndex.size(), filepath->path);
+    return true;
+}
+
+bool GCodeModule::LoadLayer(size_t layer)
+{
+    if (!currentFile || layer >= layerIndex.size())
+    {
+        printf("Layer %zu is not in the layer index.\n", layer);
+        return false;
+    }
+    if (!IsPlainTextFile(currentFile->path, "Single layer loading"))
+    {
+        return false;
+    }
+
+    MappedFile file;
+    if (!file.Open(currentFile->path))
+    {
+        printf("Failed to open file: %s\n", currentFile->path);
+        return false;
+    }
+
+    std::string_view text = file.View();
+    uint64_t begin = layerIndex[layer].offset;
+    uint64_t end = layer + 1 < layerIndex.size() ? layerIndex[layer + 1].offset : text.size();
+    if (end > text.size() || begin > end)
+    {
+        printf("Layer index does not match %s, rebuild it.\n", currentFile->path);
+        return false;
+    }
+
+    programCommands.Clear();
+    GCodeReader::ParseText(text.substr(begin, end - begin), programCommands);
+
+    ResetMachine();
+    state = layerIndex[layer].state;
+    ExecuteCommands(programCommands);
+    BuildLayerBoundaries();
+
+    printf("Loaded layer %zu at Z=%.3f: %zu points, %zu paths\n", layer, layerIndex[layer].z, points.size(), paths.size());
+    return true;
 }
 
-GCodeProgramCommand GCodeModule::ParseGCodeLine(char *line)
+bool GCodeModule::FollowFile(FilePath *filepath, const std::atomic<bool> &stop, const GCodeLayerCallback &onLayerComplete)
 {
-    GCodeProgramCommand command;
-    command.id = -1; // Default ID
+    if (!IsPlainTextFile(filepath->path, "Following"))
+    {
+        return false;
+    }
 
-    char *buffer = strtok(line, " ");
-    while (buffer != nullptr)
+    FileWatcher watcher;
+    if (!watcher.Open(filepath->path))
     {
-        if (buffer[0] == 'G' || buffer[0] == 'M')
+        printf("Failed to watch file: %s\n", filepath->path);
+        return false;
+    }
+
+    SetCurrentFile(filepath);
+
+    programCommands.Clear();
+    ResetMachine();
+
+    // Bytes after the last complete line wait for the rest of their line
+    std::string pending;
+    GCodeCommandTable table;
+    size_t completedLayers = 0;
+
+    auto consume = [&](bool final) {
+        size_t end = final ? pending.size() : pending.rfind('\n') + 1; // npos + 1 wraps to 0
+        if (end > 0)
         {
-            command.command = buffer[0];
-            command.id = atoi(&buffer[1]);
+            table.Reset();
+            GCodeReader::ParseText(std::string_view(pending.data(), end), table);
+            pending.erase(0, end);
+
+            size_t firstPath = paths.size();
+            ExecuteCommands(table);
+            if (paths.size() != firstPath)
+            {
+                ClearLayers();
+                AppendLayerBoundaries(firstPath);
+            }
         }
-        else
+
+        // Every layer but the last is done once a later one has started
+        size_t done = final ? layerBoundaries.size() : std::max<size_t>(layerBoundaries.size(), 1) - 1;
+        for (; completedLayers < done; completedLayers++)
+        {
+            if (onLayerComplete)
+            {
+                onLayerComplete(completedLayers);
+            }
+        }
+    };
+
+    auto lastGrowth = std::chrono::steady_clock::now();
+    bool idledOut = false;
+    while (!stop)
+    {
+        if (watcher.IsTruncated())
+        {
+            printf("File was truncated, following it from the start: %s\n", filepath->path);
+            watcher.Rewind();
+            pending.clear();
+            ResetMachine();
+            completedLayers = 0;
+        }
+
+        // The writer may have finished between the last read and its event,
+        // so its final bytes are read after the flag is seen
+        bool writerDone = watcher.IsWriterDone();
+        long count;
+        while ((count = watcher.ReadAppended(pending, STREAM_CHUNK_SIZE)) > 0)
+        {
+            consume(false);
+            lastGrowth = std::chrono::steady_clock::now();
+        }
+        if (count < 0)
+        {
+            printf("Failed to read file: %s\n", filepath->path);
+            return false;
+        }
+
+        if (!writerDone && std::chrono::steady_clock::now() - lastGrowth > std::chrono::milliseconds(FOLLOW_IDLE_TIMEOUT_MS))
+        {
+            printf("No new data for %d ms, treating the file as complete: %s\n", FOLLOW_IDLE_TIMEOUT_MS, filepath->path);
+            writerDone = true;
+            idledOut = true;
+        }
+        if (writerDone)
+        {
+            consume(true);
+            break;
+        }
+        watcher.Wait(FOLLOW_POLL_INTERVAL_MS);
+    }
+
+    printf("Followed %s: %llu bytes, %zu points, %zu paths, %zu layers\n", filepath->path,
+        (unsigned long long)watcher.Offset(), points.size(), paths.size(), layerBoundaries.size());
+
+    // A paused writer also goes idle, the file may still grow after the timeout
+    if (idledOut)
+    {
+        printf("Not caching %s, the writer was never seen closing it\n", filepath->path);
+    }
+    else if (!stop && useCache)
+    {
+        GCodeCache::Save(filepath->path, *this);
+    }
+    return true;
+}
+
+void GCodeModule::BuildLayerBoundaries()
+{
+    layerBoundaries.clear();
+    AppendLayerBoundaries(0);
+}
+
+void GCodeModule::AppendLayerBoundaries(size_t firstPath)
+{
+    for (size_t i = firstPath; i < paths.size(); i++)
+    {
+        float z = points[paths[i].start - 1].y; // Height is stored on y
+        if (layerBoundaries.empty() || layerBoundaries.back().z != z)
         {
-            GCodeArgument arg;
-            arg.letter = buffer[0];
-            arg.value = atof(&buffer[1]);
-            command.arguments.push_back(arg);
+            layerBoundaries.push_back({z, (uint32_t)i});
         }
-        buffer = strtok(nullptr, " ");
     }
-    return command;
 }
 
-void GCodeModule::ExtractPointsAndPaths()
+bool GCodeModule::IsPlainTextFile(const char* path, const char* operation)
+{
+    // Compressed and binary files only decode front to back, byte offsets into them mean nothing
+    if (GzipFile::IsGzipPath(path) || GCodeBinaryReader::IsBinaryPath(path))
+    {
+        printf("%s needs a plain text GCode file, load compressed or binary files instead: %s\n", operation, path);
+        return false;
+    }
+    return true;
+}
+
+void GCodeModule::SetCurrentFile(FilePath *filepath)
+{
+    // filepath may be the current file itself, copy it before replacing
+    std::unique_ptr<FilePath> file = std::make_unique<FilePath>();
+    *file = *filepath;
+    currentFile = std::move(file);
+
+    // Offsets into another file are meaningless
+    layerIndex.clear();
+}
+
+void GCodeModule::ResetMachine()
 {
+    state = GCodeMachineState();
+    points.clear();
+    paths.clear();
+    pathStates.clear();
+    layerBoundaries.clear();
+    ClearLayers();
+}
 
-    // Reset Machine
-    state.globalPosition = {0.0f, 0.0f, 0.0f, 0.0f};
-    state.homePosition = {0.0f, 0.0f, 0.0f, 0.0f};
-    state.feedrate = 0.0f;
-    state.absolutePositioning = true;
-    state.absoluteExtrusion = true;
+void GCodeModule::RecordPathState()
+{
+    auto samePoint = [](const GCodePoint &a, const GCodePoint &b) {
+        return a.x == b.x && a.y == b.y && a.z == b.z && a.e == b.e;
+    };
 
-    for (const auto &cmd : programCommands)
+    if (!pathStates.empty())
     {
+        const GCodeMachineState &last = pathStates.back().state;
+        if (last.absolutePositioning == state.absolutePositioning &&
+            last.absoluteExtrusion == state.absoluteExtrusion &&
+            samePoint(last.absolutePosition, state.absolutePosition) &&
+            samePoint(last.homePosition, state.homePosition))
+        {
+            return;
+        }
+    }
+    pathStates.push_back({(uint32_t)paths.size(), state});
+}
+
+const GCodePathState *GCodeModule::GetPathState(size_t path) const
+{
+    auto it = std::upper_bound(pathStates.begin(), pathStates.end(), path,
+        [](size_t path, const GCodePathState &entry) { return path < entry.firstPath; });
+    return it == pathStates.begin() ? nullptr : &*(it - 1);
+}
+
+void GCodeModule::ExecuteCommands(const GCodeCommandTable &table)
+{
+    for (size_t i = 0; i < table.Size(); i++)
+    {
+        GCodeProgramCommand cmd = table.Get(i);
         switch (cmd.command)
         {
         case 'G':
@@ -141,7 +620,6 @@ void GCodeModule::ProcessGCommand(const GCodeProgramCommand &cmd)
     case 0: // G0 - Rapid Move
     case 1: // G1 - Linear Move
     {
-        GCodePath path;
         GCodePoint newPoint = state.GetPosition();
         bool isMove = false;
         bool isExtrusionMove = false;
@@ -175,33 +653,15 @@ void GCodeModule::ProcessGCommand(const GCodeProgramCommand &cmd)
 
         if (isMove && isExtrusionMove)
         {
-            // Check extrusion start point vaild
-            // If point not exist or different than last point, add it
-            if (points.size() == 0)
-            {
-                points.push_back(state.GetPosition());
-            }
-            else
-            {
-                GCodePoint lastPos = points.back();
-                GCodePoint currentPos = state.GetPosition();
-                if (points.size() == 0 ||
-                    currentPos.x != lastPos.x ||
-                    currentPos.y != lastPos.y ||
-                    currentPos.z != lastPos.z)
-                {
-                    points.push_back(currentPos);
-                }
-            }
-
-            path.start = points.size();
-            points.push_back(newPoint);
-            path.end = points.size();
-            paths.push_back(path);
+            AddExtrusion(newPoint);
         }
         state.UpdatePosition(newPoint);
     }
     break;
+    case 2: // G2 - Clockwise Arc
+    case 3: // G3 - Counter-Clockwise Arc
+        ProcessArc(cmd, cmd.id == 2);
+        break;
     case 28: // G28 - Home
     {
         state.globalPosition = state.homePosition;
@@ -241,6 +701,152 @@ void GCodeModule::ProcessGCommand(const GCodeProgramCommand &cmd)
     }
 }
 
+void GCodeModule::AddExtrusion(const GCodePoint &newPoint)
+{
+    // Check extrusion start point vaild
+    // If point not exist or different than last point, add it
+    GCodePoint currentPos = state.GetPosition();
+    if (points.size() == 0 ||
+        currentPos.x != points.back().x ||
+        currentPos.y != points.back().y ||
+        currentPos.z != points.back().z)
+    {
+        points.push_back(currentPos);
+    }
+
+    RecordPathState();
+    GCodePath path;
+    path.start = (uint32_t)points.size();
+    points.push_back(newPoint);
+    path.end = (uint32_t)points.size();
+    path.feedrate = GCodePath::QuantizeFeedrate(state.feedrate);
+    path.flags = (state.absolutePositioning ? 0 : GCODE_PATH_RELATIVE_POSITIONING) |
+                 (state.absoluteExtrusion ? 0 : GCODE_PATH_RELATIVE_EXTRUSION);
+    paths.push_back(path);
+}
+
+void GCodeModule::ProcessArc(const GCodeProgramCommand &cmd, bool clockwise)
+{
+    // Arcs lie in the XY plane, which is x and z here (height is on y)
+    GCodePoint start = state.GetPosition();
+    GCodePoint end = start;
+    float i = 0.0f, j = 0.0f, r = 0.0f;
+    bool hasCenter = false, hasRadius = false;
+    bool isExtrusionMove = false;
+    for (const auto &arg : cmd.arguments)
+    {
+        switch (arg.letter)
+        {
+        case 'X':
+            end.x = arg.value;
+            break;
+        case 'Y':
+            end.z = arg.value;
+            break;
+        case 'Z':
+            end.y = arg.value;
+            break;
+        case 'E':
+            end.e = arg.value;
+            isExtrusionMove = true;
+            break;
+        case 'F':
+            state.feedrate = arg.value;
+            break;
+        case 'I':
+            i = arg.value;
+            hasCenter = true;
+            break;
+        case 'J':
+            j = arg.value;
+            hasCenter = true;
+            break;
+        case 'R':
+            r = arg.value;
+            hasRadius = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    float dx = end.x - start.x;
+    float dy = end.z - start.z;
+    if (!hasCenter && hasRadius)
+    {
+        // Centre on the chord's bisector, a negative radius picks the long way round
+        float d = std::hypot(dx, dy);
+        if (d == 0.0f)
+        {
+            printf("Ignoring G%d with R and no end point\n", cmd.id);
+            state.UpdatePosition(end);
+            return;
+        }
+        float h2 = (r - 0.5f * d) * (r + 0.5f * d);
+        float h = h2 > 0.0f ? std::sqrt(h2) : 0.0f;
+        float side = (clockwise != (r < 0.0f)) ? -1.0f : 1.0f;
+        i = 0.5f * dx - side * h * dy / d;
+        j = 0.5f * dy + side * h * dx / d;
+    }
+    else if (!hasCenter)
+    {
+        printf("Ignoring G%d without I/J or R\n", cmd.id);
+        state.UpdatePosition(end);
+        return;
+    }
+
+    // Sweep from the start to the end radius, a closed arc is a full circle
+    float centerX = start.x + i;
+    float centerY = start.z + j;
+    float startX = -i, startY = -j;
+    float endX = end.x - centerX, endY = end.z - centerY;
+    float sweep = std::atan2(startX * endY - startY * endX, startX * endX + startY * endY);
+    if (sweep < 0.0f)
+    {
+        sweep += 2.0f * (float)M_PI;
+    }
+    if (clockwise)
+    {
+        sweep -= 2.0f * (float)M_PI;
+    }
+    if (sweep == 0.0f && dx == 0.0f && dy == 0.0f)
+    {
+        sweep = clockwise ? -2.0f * (float)M_PI : 2.0f * (float)M_PI;
+    }
+
+    // Largest step whose chord stays within the tolerance of the true arc
+    float radius = std::hypot(startX, startY);
+    float tolerance = GetArcChordTolerance();
+    int segments = 1;
+    if (radius > tolerance)
+    {
+        float step = 2.0f * std::acos(1.0f - tolerance / radius);
+        segments = (int)std::ceil(std::fabs(sweep) / step);
+        segments = std::clamp(segments, 1, GCODE_ARC_MAX_SEGMENTS);
+    }
+
+    for (int k = 1; k <= segments; k++)
+    {
+        GCodePoint point = end;
+        if (k < segments)
+        {
+            float t = (float)k / segments;
+            float angle = sweep * t;
+            float c = std::cos(angle), s = std::sin(angle);
+            point.x = centerX + startX * c - startY * s;
+            point.z = centerY + startX * s + startY * c;
+            point.y = start.y + (end.y - start.y) * t;
+            point.e = start.e + (end.e - start.e) * t;
+        }
+
+        if (isExtrusionMove)
+        {
+            AddExtrusion(point);
+        }
+        state.UpdatePosition(point);
+    }
+}
+
 void GCodeModule::ProcessMCommand(const GCodeProgramCommand &cmd)
 {
     switch (cmd.id)
@@ -296,7 +902,7 @@ void GCodeModule::SavePointsAndPathsToObj(const char *outputPath)
     // Edges
     for (const auto &path : paths)
     {
-        fprintf(file, "l %d %d\n", path.start, path.end);
+        fprintf(file, "l %u %u\n", path.start, path.end);
     }
 
     fclose(file);
@@ -304,122 +910,228 @@ void GCodeModule::SavePointsAndPathsToObj(const char *outputPath)
 }
 
 Object GCodeModule::ConvertPathToRenderObject() {
+    return PathsToRenderObject(points, paths, quantizeRender);
+}
+
+Object GCodeModule::PathsToRenderObject(const std::vector<GCodePoint>& points, const std::vector<GCodePath>& paths, bool quantize) {
     Object obj;
     obj.drawMode = GL_LINES;
     obj.useIndices = true;
     obj.setUniform("Color", glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
 
-    std::vector<float> vertices;
-    for (const auto& p : points) {
-        vertices.push_back(p.x);
-        vertices.push_back(p.y);
-        vertices.push_back(p.z);
-    }
-    obj.vertices = vertices;
-
     std::vector<unsigned int> indices;
+    indices.reserve(paths.size() * 2);
     for (const auto& path : paths) {
         // IMPORTANT: Subtract 1 because OBJ is 1-indexed, OpenGL is 0-indexed
         indices.push_back((unsigned int)path.start - 1);
         indices.push_back((unsigned int)path.end - 1);
     }
-    obj.indices = indices;
     obj.vertexCount = (uint32_t)indices.size();
 
     glGenVertexArrays(1, &obj.VAO);
     glBindVertexArray(obj.VAO);
 
-    GLuint vbo, ebo;
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    GCodeQuantizedPoints quantized;
+    if (quantize && GCodeQuantizer::Encode(points, quantized)) {
+        // Decoded by the "gcode_quantized" vertex shader, no float copy of
+        // the points is made on the host or on the GPU
+        obj.shaderName = "gcode_quantized";
+
+        GLuint coordVbo, runVbo;
+        glGenBuffers(1, &coordVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, coordVbo);
+        glBufferData(GL_ARRAY_BUFFER, quantized.coords.size() * sizeof(uint16_t), quantized.coords.data(), GL_STATIC_DRAW);
+        glVertexAttribIPointer(0, 2, GL_UNSIGNED_SHORT, 2 * sizeof(uint16_t), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        glGenBuffers(1, &runVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, runVbo);
+        glBufferData(GL_ARRAY_BUFFER, quantized.runIndices.size() * sizeof(uint16_t), quantized.runIndices.data(), GL_STATIC_DRAW);
+        glVertexAttribIPointer(1, 1, GL_UNSIGNED_SHORT, sizeof(uint16_t), (void*)0);
+        glEnableVertexAttribArray(1);
+
+        // Run table is read with texelFetch, one RGBA32F texel per run
+        GLuint runBuffer;
+        glGenBuffers(1, &runBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, runBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, quantized.runs.size() * sizeof(GCodeQuantRun), quantized.runs.data(), GL_STATIC_DRAW);
+        obj.buffers = {coordVbo, runVbo, runBuffer};
+        glGenTextures(1, &obj.dataTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, obj.dataTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, runBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        obj.setUniform("u_Runs", 0);
+
+        printf("Quantized %zu points into %zu runs\n", quantized.Size(), quantized.runs.size());
+    } else {
+        std::vector<float> vertices;
+        vertices.reserve(points.size() * 3);
+        for (const auto& p : points) {
+            vertices.push_back(p.x);
+            vertices.push_back(p.y);
+            vertices.push_back(p.z);
+        }
+
+        GLuint vbo;
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+        obj.buffers = {vbo};
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
 
+        obj.vertices = std::move(vertices);
+    }
+
+    GLuint ebo;
     glGenBuffers(1, &ebo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    obj.buffers.push_back(ebo);
 
     glBindVertexArray(0);
     return obj;
 }
 
-std::vector<GCodeLayer> GCodeModule::ExtractLayers() {
-    std::vector<GCodeLayer> layers;
-    float layer_height = 0.0f;
-    float last_y = 0.0f;
-    
+const std::vector<GCodeLayer>& GCodeModule::ExtractLayers() {
+    if (layersExtracted) {
+        return layers;
+    }
+    ClearLayers();
+    layersExtracted = true;
+
     if (paths.empty()) {
         printf("No paths available to extract layers.\n");
         return layers;
     }
 
-    auto getLayerWithY = [&](float y) -> GCodeLayer* {
-        for (auto& layer : layers) {
-            if (layer.layer == y) {
-                return &layer;
+    const int64_t noLayer = INT64_MIN;
+    auto quantize = [](float z) -> int64_t {
+        return std::llround(z * GCODE_LAYER_Z_RESOLUTION);
+    };
+
+    // Height key of every path, paths that change height belong to no layer
+    std::vector<int64_t> keys(paths.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, paths.size()),
+        [&](const tbb::blocked_range<size_t>& range) {
+            for (size_t i = range.begin(); i != range.end(); i++) {
+                int64_t startKey = quantize(points[paths[i].start - 1].y); // Height is stored on y
+                int64_t endKey = quantize(points[paths[i].end - 1].y);
+                keys[i] = startKey == endKey ? startKey : noLayer;
             }
-        }
-        return nullptr;
-    }; 
+        });
+
+    // Sorted table of distinct heights. Paths come mostly grouped by height,
+    // so each range only keeps the key at the start of every run.
+    tbb::combinable<std::vector<int64_t>> runKeys;
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, keys.size()),
+        [&](const tbb::blocked_range<size_t>& range) {
+            std::vector<int64_t>& local = runKeys.local();
+            for (size_t i = range.begin(); i != range.end(); i++) {
+                if (keys[i] != noLayer && (local.empty() || local.back() != keys[i])) {
+                    local.push_back(keys[i]);
+                }
+            }
+        });
 
-    int global_index = 0;
-    for(auto & path : paths) {
-        GCodePoint startPoint = points[path.start-1]; // Adjust for 0-based index
-        GCodePoint endPoint = points[path.end-1];
+    std::vector<int64_t> layerKeys;
+    runKeys.combine_each([&](const std::vector<int64_t>& local) {
+        layerKeys.insert(layerKeys.end(), local.begin(), local.end());
+    });
+    std::sort(layerKeys.begin(), layerKeys.end());
+    layerKeys.erase(std::unique(layerKeys.begin(), layerKeys.end()), layerKeys.end());
 
-        if(startPoint.y != endPoint.y) {
-            printf("Warning: Path with differing Z heights (start: %.2f, end: %.2f). Using start height.\n", startPoint.y, endPoint.y);
-            continue;
-        }
+    // Bucket of every path, the previous lookup is reused along runs
+    const uint32_t noBucket = UINT32_MAX;
+    std::vector<uint32_t> buckets(paths.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, keys.size()),
+        [&](const tbb::blocked_range<size_t>& range) {
+            int64_t lastKey = noLayer;
+            uint32_t lastBucket = noBucket;
+            for (size_t i = range.begin(); i != range.end(); i++) {
+                if (keys[i] != lastKey) {
+                    lastKey = keys[i];
+                    lastBucket = lastKey == noLayer ? noBucket :
+                        (uint32_t)(std::lower_bound(layerKeys.begin(), layerKeys.end(), lastKey) - layerKeys.begin());
+                }
+                buckets[i] = lastBucket;
+            }
+        });
+    keys = std::vector<int64_t>();
+
+    if (layerKeys.empty()) {
+        printf("No paths with a constant Z height to extract layers from.\n");
+        return layers;
+    }
+
+    // Counting sort over fixed blocks: count per block, offset the blocks of
+    // each layer in order, then scatter. Paths keep their file order inside a
+    // layer. The block count is capped so the counters stay small when there
+    // are many layers (vase mode).
+    size_t layerCount = layerKeys.size();
+    size_t blockCount = std::min((paths.size() + 65535) / 65536, (size_t)tbb::info::default_concurrency() * 4);
+    blockCount = std::max<size_t>(1, std::min(blockCount, ((size_t)1 << 24) / layerCount));
+    size_t blockSize = (paths.size() + blockCount - 1) / blockCount;
 
-        if(last_y == 0.0f) {
-            last_y = startPoint.y;
-            layer_height = startPoint.y;
-        }else if(last_y != startPoint.y) {
-            layer_height = fabs(startPoint.y - last_y);
-            last_y = startPoint.y;
+    std::vector<uint32_t> counters(blockCount * layerCount, 0);
+    tbb::parallel_for((size_t)0, blockCount, [&](size_t block) {
+        uint32_t* counts = counters.data() + block * layerCount;
+        size_t end = std::min(paths.size(), (block + 1) * blockSize);
+        for (size_t i = block * blockSize; i < end; i++) {
+            if (buckets[i] != noBucket) {
+                counts[buckets[i]]++;
+            }
         }
+    });
 
-        GCodeLayer* layer = getLayerWithY(startPoint.y);
-        if(layer == nullptr) {
-            GCodeLayer newLayer;
-            newLayer.layer = startPoint.y;
-            newLayer.layerHeight = layer_height;
-            layers.push_back(newLayer);
-            layer = &layers.back();
-            printf("Created new layer at Z=%.2f with height %.2f\n", newLayer.layer, newLayer.layerHeight);
+    std::vector<uint32_t> layerStarts(layerCount + 1);
+    uint32_t offset = 0;
+    for (size_t layer = 0; layer < layerCount; layer++) {
+        layerStarts[layer] = offset;
+        for (size_t block = 0; block < blockCount; block++) {
+            uint32_t count = counters[block * layerCount + layer];
+            counters[block * layerCount + layer] = offset;
+            offset += count;
         }
+    }
+    layerStarts[layerCount] = offset;
 
-        GCodePath layerPath;
-
-        // reindex points and path to insert into layer
-        
-        // start index - end index checking
-
-        int startIndex = (int)layer->points.size();
-        if(startIndex == 0) {
-            layer->points.push_back(startPoint);
-            layerPath.start = 0;
-            layerPath.end = 1;
-        }else if(layer->points.back().x == startPoint.x &&
-           layer->points.back().y == startPoint.y &&
-           layer->points.back().z == startPoint.z ) {
-            layerPath.start = startIndex-1;
-            layerPath.end = startIndex;
-        }else{
-            layer->points.push_back(startPoint);
-            layerPath.start = startIndex;
-            layerPath.end = startIndex + 1;
+    layerPaths.resize(offset);
+    tbb::parallel_for((size_t)0, blockCount, [&](size_t block) {
+        uint32_t* next = counters.data() + block * layerCount;
+        size_t end = std::min(paths.size(), (block + 1) * blockSize);
+        for (size_t i = block * blockSize; i < end; i++) {
+            if (buckets[i] != noBucket) {
+                layerPaths[next[buckets[i]]++] = (uint32_t)i;
+            }
         }
-        layer->points.push_back(endPoint);
-        layerPath.state = path.state;
-        layer->paths.push_back(layerPath);
+    });
+
+    if (offset != paths.size()) {
+        printf("Warning: Skipped %zu paths with differing Z heights.\n", paths.size() - offset);
     }
 
+    layers.reserve(layerCount);
+    float lastZ = 0.0f;
+    for (size_t layer = 0; layer < layerCount; layer++) {
+        GCodeLayer gcodeLayer;
+        gcodeLayer.layer = (float)(layerKeys[layer] / GCODE_LAYER_Z_RESOLUTION);
+        gcodeLayer.layerHeight = gcodeLayer.layer - lastZ;
+        gcodeLayer.paths = std::span<const uint32_t>(layerPaths.data() + layerStarts[layer], layerStarts[layer + 1] - layerStarts[layer]);
+        lastZ = gcodeLayer.layer;
+        layers.push_back(gcodeLayer);
+    }
 
     printf("Extracted %zu layers from GCode.\n", layers.size());
 
     return layers;
-}
\ No newline at end of file
+}
+
+void GCodeModule::ClearLayers()
+{
+    layersExtracted = false;
+    layers = std::vector<GCodeLayer>();
+    layerPaths = std::vector<uint32_t>();
+}
@@ -1,14 +1,16 @@
 #pragma once
 #include <cstdio>
+#include <cstdint>
+#include <span>
 #include <unordered_map>
 #include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <algorithm>
 #include <memory>
-
-#define READER_BUFFER_SIZE 256
-#define PROGRAM_BUFFER_SIZE 128
+#include <atomic>
+#include <functional>
 
 struct GCodePoint {
     float x;
@@ -84,10 +86,38 @@ struct GCodeMachineState{
     }
 };
 
+#define GCODE_PATH_RELATIVE_POSITIONING 0x01
+#define GCODE_PATH_RELATIVE_EXTRUSION 0x02
+
+// Feedrate is stored in whole mm/min, saturating at UINT16_MAX
+#define GCODE_FEEDRATE_SCALE 1.0f
+
+// Compact extrusion segment, start and end index into points (1-based).
+// Machine state other than feedrate and modes lives in GCodeModule::pathStates.
 struct GCodePath{
+    uint32_t start;
+    uint32_t end;
+    uint16_t feedrate;
+    uint8_t flags;
+
+    static uint16_t QuantizeFeedrate(float feedrate){
+        float scaled = feedrate * GCODE_FEEDRATE_SCALE + 0.5f;
+        if (!(scaled > 0.0f)) {
+            return 0;
+        }
+        return scaled >= (float)UINT16_MAX ? UINT16_MAX : (uint16_t)scaled;
+    }
+
+    float GetFeedrate() const {
+        return feedrate / GCODE_FEEDRATE_SCALE;
+    }
+};
+
+// Machine state in effect from firstPath on, only recorded when the modes or
+// position offsets change so it stays sparse
+struct GCodePathState{
+    uint32_t firstPath;
     GCodeMachineState state;
-    int start;
-    int end;
 };
 
 struct GCodeArgument{
@@ -95,19 +125,116 @@ struct GCodeArgument{
     float value;
 };
 
+#define MAX_COMMAND_ARGUMENTS UINT16_MAX
+
+// View of a single parsed command, arguments point into the owning table
 struct GCodeProgramCommand{
     char command;
     int id;
+    std::span<const GCodeArgument> arguments;
+};
+
+// Structure of arrays command table. Arguments of all commands share one
+// contiguous pool, each command only stores its offset and count into it.
+struct GCodeCommandTable{
+    std::vector<char> commands;
+    std::vector<int> ids;
+    std::vector<uint32_t> argumentOffsets;
+    std::vector<uint16_t> argumentCounts;
     std::vector<GCodeArgument> arguments;
+
+    size_t Size() const {
+        return commands.size();
+    }
+
+    bool Empty() const {
+        return commands.empty();
+    }
+
+    GCodeProgramCommand Get(size_t i) const {
+        return {commands[i], ids[i], std::span<const GCodeArgument>(arguments.data() + argumentOffsets[i], argumentCounts[i])};
+    }
+
+    void Reserve(size_t commandCount, size_t argumentCount){
+        commands.reserve(commandCount);
+        ids.reserve(commandCount);
+        argumentOffsets.reserve(commandCount);
+        argumentCounts.reserve(commandCount);
+        arguments.reserve(argumentCount);
+    }
+
+    void Reset(){
+        // Empty the table but keep its capacity for reuse
+        commands.clear();
+        ids.clear();
+        argumentOffsets.clear();
+        argumentCounts.clear();
+        arguments.clear();
+    }
+
+    void Clear(){
+        // Release the memory as well, tables of big files are huge
+        GCodeCommandTable().Swap(*this);
+    }
+
+    void Swap(GCodeCommandTable& other){
+        commands.swap(other.commands);
+        ids.swap(other.ids);
+        argumentOffsets.swap(other.argumentOffsets);
+        argumentCounts.swap(other.argumentCounts);
+        arguments.swap(other.arguments);
+    }
+
+    void Append(const GCodeCommandTable& other){
+        uint32_t base = (uint32_t)arguments.size();
+        commands.insert(commands.end(), other.commands.begin(), other.commands.end());
+        ids.insert(ids.end(), other.ids.begin(), other.ids.end());
+        for (uint32_t offset : other.argumentOffsets) {
+            argumentOffsets.push_back(base + offset);
+        }
+        argumentCounts.insert(argumentCounts.end(), other.argumentCounts.begin(), other.argumentCounts.end());
+        arguments.insert(arguments.end(), other.arguments.begin(), other.arguments.end());
+    }
 };
 
+// First path of each run of paths printed at the same height
+struct GCodeLayerBoundary{
+    float z;
+    uint32_t firstPath;
+};
+
+// Where a layer starts in the source file and the machine state at that
+// point, enough to interpret the layer without replaying the file before it
+struct GCodeLayerIndexEntry{
+    float z;
+    uint64_t offset;
+    GCodeMachineState state;
+};
+
+// Layer heights are bucketed on a micron grid
+#define GCODE_LAYER_Z_RESOLUTION 1000.0
+
+// Paths printed at one height, as indices into GCodeModule::paths in file order
 struct GCodeLayer{
     float layer;
     float layerHeight;
-    std::vector<GCodePoint> points;
-    std::vector<GCodePath> paths;
+    std::span<const uint32_t> paths;
 };
 
+// Arc chords stay within this fraction of the nozzle diameter of the true arc
+#define GCODE_ARC_CHORD_TOLERANCE 0.05f
+#define GCODE_ARC_MAX_SEGMENTS 4096
+
+// Longest wait for file changes before the stop flag is checked again
+#define FOLLOW_POLL_INTERVAL_MS 200
+// A file that has not grown for this long counts as finished, its writer may never send a close event
+#define FOLLOW_IDLE_TIMEOUT_MS 10000
+// Shortest time between two uploads of a followed file's preview, each one uploads every layer so far
+#define FOLLOW_PREVIEW_INTERVAL_MS 1000
+
+// Receives the index into layerBoundaries of a layer once it is complete
+using GCodeLayerCallback = std::function<void(size_t layer)>;
+
 class Object;
 struct FilePath;
 
@@ -115,21 +242,70 @@ class GCodeModule{
 public:
     std::vector<GCodePoint> points;
     std::vector<GCodePath> paths;
+    std::vector<GCodePathState> pathStates;
+    std::vector<GCodeLayerBoundary> layerBoundaries;
+    std::vector<GCodeLayerIndexEntry> layerIndex;
     GCodeMachineState state;
     std::unique_ptr<FilePath> currentFile;
+    bool parallelParse = true;
+    bool streamingParse = false;
+    bool useCache = true;
+    bool quantizeRender = true;
+    float nozzleDiameter = 0.4f;
+    // Largest distance (mm) of an arc chord from the true arc
+    float GetArcChordTolerance() const { return nozzleDiameter * GCODE_ARC_CHORD_TOLERANCE; }
 
-    std::vector<GCodeProgramCommand> programCommands;
-    void OpenFile(FilePath* filepath);
-    GCodeProgramCommand ParseGCodeLine(char* line);
+    GCodeCommandTable programCommands;
+    // False if the file could not be read or was only partly decoded, nothing is cached then
+    bool LoadFile(FilePath* filepath);
+    bool OpenFile(FilePath* filepath);
+    bool ParseGCodeLine(std::string_view line, GCodeCommandTable& table);
 
     void ExtractPointsAndPaths();
+    const GCodePathState* GetPathState(size_t path) const;
+    bool StreamFile(FilePath* filepath);
+    // Inflates .gz files on the fly, nothing is written to disk
+    bool StreamGzipFile(FilePath* filepath);
+    // Binary G-code (.bgcode), blocks are decoded in parallel
+    bool StreamBinaryFile(FilePath* filepath);
+    void BuildLayerBoundaries();
+    void BenchmarkLexer();
+
+    // Lazy layer access, the index is built in one pass without keeping any
+    // paths, a single layer can then be loaded in place of the whole file
+    bool BuildLayerIndex(FilePath* filepath);
+    bool LoadLayer(size_t layer);
+
+    // Tail-follow mode for files still being written. Only appended bytes are
+    // parsed, interpretation resumes from the current state and a layer is
+    // reported as soon as the next one starts, on the following thread.
+    // Returns once the writer closes the file, it stops growing for
+    // FOLLOW_IDLE_TIMEOUT_MS or stop is set. Only a file seen closed is cached.
+    bool FollowFile(FilePath* filepath, const std::atomic<bool>& stop, const GCodeLayerCallback& onLayerComplete);
+
     Object ConvertPathToRenderObject();
+    static Object PathsToRenderObject(const std::vector<GCodePoint>& points, const std::vector<GCodePath>& paths, bool quantize);
 
-    std::vector<GCodeLayer> ExtractLayers();
+    // Cached until the toolpaths change, the views point into the module
+    const std::vector<GCodeLayer>& ExtractLayers();
 
     void SavePointsAndPathsToObj(const char* outputPath);
 
 private:
+    std::vector<GCodeLayer> layers;
+    std::vector<uint32_t> layerPaths;
+    bool layersExtracted = false;
+
+    void SetCurrentFile(FilePath* filepath);
+    // Entry points that map the file and lex it directly only handle plain text
+    static bool IsPlainTextFile(const char* path, const char* operation);
+    void ResetMachine();
+    void ClearLayers();
+    void AppendLayerBoundaries(size_t firstPath);
+    void RecordPathState();
+    void ExecuteCommands(const GCodeCommandTable& table);
     void ProcessGCommand(const GCodeProgramCommand& cmd);
+    void ProcessArc(const GCodeProgramCommand& cmd, bool clockwise);
+    void AddExtrusion(const GCodePoint& newPoint);
     void ProcessMCommand(const GCodeProgramCommand& cmd);
 };
\ No newline at end of file
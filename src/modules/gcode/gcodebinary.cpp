@@ -0,0 +1,347 @@
+#include "gcodebinary.h"
+#include "gcodereader.h"
+
+#include <cstring>
+
+#include <zlib.h>
+
+static const char BGCODE_MAGIC[4] = {'G', 'C', 'D', 'E'};
+
+// MeatPack stream markers, two signal bytes announce a command byte
+#define MEATPACK_SIGNAL 0xFF
+#define MEATPACK_ENABLE_PACKING 0xFB
+#define MEATPACK_DISABLE_PACKING 0xFA
+#define MEATPACK_RESET_ALL 0xF9
+#define MEATPACK_ENABLE_NO_SPACES 0xF7
+#define MEATPACK_DISABLE_NO_SPACES 0xF6
+
+// A nibble of all ones means the character follows as a full byte
+#define MEATPACK_FULL_CHAR 0xF
+
+template<typename T>
+static T ReadValue(const char* data)
+{
+    T value;
+    memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+bool GCodeBinaryReader::IsBinaryPath(const char* path)
+{
+    size_t length = strlen(path);
+    size_t extension = sizeof(BGCODE_EXTENSION) - 1;
+    return length >= extension && strcmp(path + length - extension, BGCODE_EXTENSION) == 0;
+}
+
+bool GCodeBinaryReader::ReadFileHeader(std::string_view& data, BGCodeChecksum& checksum)
+{
+    // Magic, version and checksum type
+    const size_t headerSize = 4 + sizeof(uint32_t) + sizeof(uint16_t);
+    if (data.size() < headerSize || memcmp(data.data(), BGCODE_MAGIC, sizeof(BGCODE_MAGIC)) != 0)
+    {
+        return false;
+    }
+
+    uint32_t version = ReadValue<uint32_t>(data.data() + 4);
+    checksum = (BGCodeChecksum)ReadValue<uint16_t>(data.data() + 8);
+    if (version != BGCODE_VERSION || (checksum != BGCodeChecksum::NONE && checksum != BGCodeChecksum::CRC32))
+    {
+        printf("Unsupported binary GCode version %u or checksum %u\n", version, (unsigned)checksum);
+        return false;
+    }
+
+    data.remove_prefix(headerSize);
+    return true;
+}
+
+bool GCodeBinaryReader::NextBlock(std::string_view& data, BGCodeChecksum checksum, BGCodeBlock& block)
+{
+    // Type, compression and uncompressed size, the compressed size only
+    // follows for compressed blocks
+    const size_t baseSize = 2 * sizeof(uint16_t) + sizeof(uint32_t);
+    if (data.size() < baseSize)
+    {
+        return false;
+    }
+
+    block.type = (BGCodeBlockType)ReadValue<uint16_t>(data.data());
+    block.compression = (BGCodeCompression)ReadValue<uint16_t>(data.data() + 2);
+    block.uncompressedSize = ReadValue<uint32_t>(data.data() + 4);
+
+    size_t headerSize = baseSize;
+    uint32_t payloadSize = block.uncompressedSize;
+    if (block.compression != BGCodeCompression::NONE)
+    {
+        if (data.size() < baseSize + sizeof(uint32_t))
+        {
+            return false;
+        }
+        payloadSize = ReadValue<uint32_t>(data.data() + baseSize);
+        headerSize += sizeof(uint32_t);
+    }
+
+    // Thumbnails carry format, width and height, every other block its encoding
+    size_t parameterSize = block.type == BGCodeBlockType::THUMBNAIL ? 3 * sizeof(uint16_t) : sizeof(uint16_t);
+    size_t checksumSize = checksum == BGCodeChecksum::CRC32 ? sizeof(uint32_t) : 0;
+    size_t blockSize = headerSize + parameterSize + payloadSize + checksumSize;
+    if (data.size() < blockSize)
+    {
+        return false;
+    }
+
+    block.encoding = ReadValue<uint16_t>(data.data() + headerSize);
+    block.header = data.substr(0, headerSize + parameterSize);
+    block.payload = data.substr(headerSize + parameterSize, payloadSize);
+    block.checksum = data.substr(headerSize + parameterSize + payloadSize, checksumSize);
+
+    data.remove_prefix(blockSize);
+    return true;
+}
+
+bool GCodeBinaryReader::VerifyChecksum(const BGCodeBlock& block)
+{
+    if (block.checksum.empty())
+    {
+        return true;
+    }
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, (const Bytef*)block.header.data(), (uInt)block.header.size());
+    crc = crc32(crc, (const Bytef*)block.payload.data(), (uInt)block.payload.size());
+    return (uint32_t)crc == ReadValue<uint32_t>(block.checksum.data());
+}
+
+bool GCodeBinaryReader::Decompress(const BGCodeBlock& block, std::string& out)
+{
+    switch (block.compression)
+    {
+    case BGCodeCompression::NONE:
+        out.assign(block.payload);
+        return true;
+    case BGCodeCompression::DEFLATE:
+    {
+        out.resize(block.uncompressedSize);
+        uLongf size = block.uncompressedSize;
+        if (uncompress((Bytef*)out.data(), &size, (const Bytef*)block.payload.data(), (uLong)block.payload.size()) != Z_OK)
+        {
+            return false;
+        }
+        out.resize(size);
+        return size == block.uncompressedSize;
+    }
+    case BGCodeCompression::HEATSHRINK_11_4:
+        return Heatshrink(block.payload, 11, 4, block.uncompressedSize, out);
+    case BGCodeCompression::HEATSHRINK_12_4:
+        return Heatshrink(block.payload, 12, 4, block.uncompressedSize, out);
+    default:
+        return false;
+    }
+}
+
+bool GCodeBinaryReader::Heatshrink(std::string_view in, int windowBits, int lookaheadBits, size_t outSize, std::string& out)
+{
+    // LZSS bit stream, most significant bit first. A set tag bit is followed
+    // by a literal byte, a clear one by a back reference (index, count).
+    out.clear();
+    out.reserve(outSize);
+
+    const uint8_t* data = (const uint8_t*)in.data();
+    size_t byteIndex = 0;
+    uint64_t bits = 0;
+    int bitCount = 0;
+    auto readBits = [&](int count, uint32_t& value) -> bool {
+        while (bitCount < count)
+        {
+            if (byteIndex == in.size())
+            {
+                return false;
+            }
+            bits = (bits << 8) | data[byteIndex++];
+            bitCount += 8;
+        }
+        bitCount -= count;
+        value = (uint32_t)(bits >> bitCount) & ((1u << count) - 1);
+        return true;
+    };
+
+    while (out.size() < outSize)
+    {
+        uint32_t tag, value;
+        if (!readBits(1, tag))
+        {
+            break;
+        }
+
+        if (tag)
+        {
+            if (!readBits(8, value))
+            {
+                break;
+            }
+            out.push_back((char)value);
+            continue;
+        }
+
+        uint32_t index, count;
+        if (!readBits(windowBits, index) || !readBits(lookaheadBits, count))
+        {
+            break;
+        }
+        index += 1;
+        count += 1;
+        for (uint32_t i = 0; i < count && out.size() < outSize; i++)
+        {
+            // The decoder window starts zero filled
+            out.push_back(out.size() >= index ? out[out.size() - index] : '\0');
+        }
+    }
+    return out.size() == outSize;
+}
+
+void GCodeBinaryReader::MeatPack(std::string_view in, GCodeCommandTable& table)
+{
+    // Packed characters are two per byte, low nibble first. Each finished
+    // line is parsed on the spot, only the current line is ever held.
+    static const char packedChars[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '.', ' ', '\n', 'G', 'X', '\0'};
+
+    bool packing = false;
+    bool noSpaces = false;
+    int signals = 0;
+    int fullChars = 0;  // full width characters still to come
+    char heldChar = 0;  // packed character waiting behind a full width one
+    std::string line;
+
+    auto emit = [&](char c) {
+        if (c != '\n')
+        {
+            line.push_back(c);
+            return;
+        }
+        GCodeReader::ParseProgram(GCodeReader::ExtractProgram(line), table);
+        line.clear();
+    };
+
+    auto unpack = [&](uint8_t c) {
+        if (!packing)
+        {
+            emit((char)c);
+            return;
+        }
+
+        if (fullChars > 0)
+        {
+            emit((char)c);
+            if (heldChar != 0)
+            {
+                emit(heldChar);
+                heldChar = 0;
+            }
+            fullChars--;
+            return;
+        }
+
+        auto decode = [&](uint8_t nibble) {
+            return nibble == 11 && noSpaces ? 'E' : packedChars[nibble];
+        };
+        uint8_t low = c & 0xF;
+        uint8_t high = c >> 4;
+
+        if (low == MEATPACK_FULL_CHAR)
+        {
+            fullChars++;
+            if (high == MEATPACK_FULL_CHAR)
+            {
+                fullChars++;
+            }
+            else
+            {
+                heldChar = decode(high);
+            }
+            return;
+        }
+
+        char first = decode(low);
+        emit(first);
+        if (first == '\n')
+        {
+            // A line end in the low nibble pads out the byte
+            return;
+        }
+        if (high == MEATPACK_FULL_CHAR)
+        {
+            fullChars++;
+        }
+        else
+        {
+            emit(decode(high));
+        }
+    };
+
+    for (char ch : in)
+    {
+        uint8_t c = (uint8_t)ch;
+        if (signals == 2)
+        {
+            switch (c)
+            {
+            case MEATPACK_ENABLE_PACKING: packing = true; break;
+            case MEATPACK_DISABLE_PACKING: packing = false; break;
+            case MEATPACK_RESET_ALL: packing = false; noSpaces = false; break;
+            case MEATPACK_ENABLE_NO_SPACES: noSpaces = true; break;
+            case MEATPACK_DISABLE_NO_SPACES: noSpaces = false; break;
+            default: break;
+            }
+            signals = 0;
+            continue;
+        }
+
+        if (c == MEATPACK_SIGNAL)
+        {
+            signals++;
+            continue;
+        }
+
+        // A lone signal byte was data after all
+        if (signals == 1)
+        {
+            unpack(MEATPACK_SIGNAL);
+            signals = 0;
+        }
+        unpack(c);
+    }
+
+    if (!line.empty())
+    {
+        GCodeReader::ParseProgram(GCodeReader::ExtractProgram(line), table);
+    }
+}
+
+bool GCodeBinaryReader::DecodeGCodeBlock(const BGCodeBlock& block, GCodeCommandTable& table)
+{
+    if (!VerifyChecksum(block))
+    {
+        printf("Binary GCode block checksum mismatch\n");
+        return false;
+    }
+
+    std::string data;
+    if (!Decompress(block, data))
+    {
+        printf("Failed to decompress binary GCode block\n");
+        return false;
+    }
+
+    switch ((BGCodeEncoding)block.encoding)
+    {
+    case BGCodeEncoding::NONE:
+        GCodeReader::ParseText(data, table);
+        return true;
+    case BGCodeEncoding::MEATPACK:
+    case BGCodeEncoding::MEATPACK_COMMENTS:
+        MeatPack(data, table);
+        return true;
+    default:
+        printf("Unsupported binary GCode encoding %u\n", (unsigned)block.encoding);
+        return false;
+    }
+}
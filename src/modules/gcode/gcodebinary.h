@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "gcode.h"
+
+#define BGCODE_EXTENSION ".bgcode"
+#define BGCODE_VERSION 1
+
+enum class BGCodeBlockType : uint16_t{
+    FILE_METADATA = 0,
+    GCODE = 1,
+    SLICER_METADATA = 2,
+    PRINTER_METADATA = 3,
+    PRINT_METADATA = 4,
+    THUMBNAIL = 5
+};
+
+enum class BGCodeCompression : uint16_t{
+    NONE = 0,
+    DEFLATE = 1,
+    HEATSHRINK_11_4 = 2,
+    HEATSHRINK_12_4 = 3
+};
+
+enum class BGCodeEncoding : uint16_t{
+    NONE = 0,
+    MEATPACK = 1,
+    MEATPACK_COMMENTS = 2
+};
+
+enum class BGCodeChecksum : uint16_t{
+    NONE = 0,
+    CRC32 = 1
+};
+
+// A block of the file, payload and checksum point into the mapped file
+struct BGCodeBlock{
+    BGCodeBlockType type;
+    BGCodeCompression compression;
+    uint16_t encoding;
+    uint32_t uncompressedSize;
+    std::string_view header;     // block header and parameters, covered by the checksum
+    std::string_view payload;
+    std::string_view checksum;
+};
+
+// Reader for the binary G-code container (.bgcode). Blocks are located with
+// a cheap header walk, each G-code block can then be decompressed and
+// MeatPack decoded independently of the others. Decoded lines go straight
+// into a command table, the file is never turned back into text.
+class GCodeBinaryReader{
+public:
+    static bool IsBinaryPath(const char* path);
+
+    // Checks the file header and pops it from data
+    static bool ReadFileHeader(std::string_view& data, BGCodeChecksum& checksum);
+    // Pops the next block from data, false at the end or on a damaged header
+    static bool NextBlock(std::string_view& data, BGCodeChecksum checksum, BGCodeBlock& block);
+
+    // Appends the commands of a G-code block to the table
+    static bool DecodeGCodeBlock(const BGCodeBlock& block, GCodeCommandTable& table);
+
+private:
+    static bool VerifyChecksum(const BGCodeBlock& block);
+    static bool Decompress(const BGCodeBlock& block, std::string& out);
+    static bool Heatshrink(std::string_view in, int windowBits, int lookaheadBits, size_t outSize, std::string& out);
+    static void MeatPack(std::string_view in, GCodeCommandTable& table);
+};
@@ -0,0 +1,185 @@
+#include "gcodecache.h"
+#include "gcode.h"
+#include "../file/mappedfile.h"
+
+#include <cstring>
+#include <cstdio>
+#include <type_traits>
+#include <sys/stat.h>
+
+static_assert(std::is_trivially_copyable_v<GCodePoint>, "GCodePoint must be trivially copyable to be cached");
+static_assert(std::is_trivially_copyable_v<GCodePath>, "GCodePath must be trivially copyable to be cached");
+static_assert(std::is_trivially_copyable_v<GCodePathState>, "GCodePathState must be trivially copyable to be cached");
+static_assert(std::is_trivially_copyable_v<GCodeLayerBoundary>, "GCodeLayerBoundary must be trivially copyable to be cached");
+
+static const char CACHE_MAGIC[4] = {'R', 'G', 'C', '\0'};
+
+std::string GCodeCache::GetCachePath(const char* gcodePath)
+{
+    return std::string(gcodePath) + GCODE_CACHE_EXTENSION;
+}
+
+uint64_t GCodeCache::HashContent(std::string_view text)
+{
+    // FNV-1a over 8 byte words, a tail shorter than a word is folded bytewise
+    auto hashRange = [](uint64_t hash, const char* data, size_t size) {
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(word));
+            hash = (hash ^ word) * 0x100000001b3ULL;
+        }
+        for (; i < size; i++)
+        {
+            hash = (hash ^ (uint8_t)data[i]) * 0x100000001b3ULL;
+        }
+        return hash;
+    };
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const size_t sampledSize = (size_t)GCODE_CACHE_HASH_SAMPLES * GCODE_CACHE_HASH_BLOCK;
+    if (text.size() <= sampledSize)
+    {
+        return hashRange(hash, text.data(), text.size());
+    }
+
+    // Evenly spaced blocks, the last one ends exactly at the end of the file
+    size_t stride = (text.size() - GCODE_CACHE_HASH_BLOCK) / (GCODE_CACHE_HASH_SAMPLES - 1);
+    for (size_t i = 0; i < GCODE_CACHE_HASH_SAMPLES; i++)
+    {
+        hash = hashRange(hash, text.data() + i * stride, GCODE_CACHE_HASH_BLOCK);
+    }
+    return hash;
+}
+
+bool GCodeCache::FillHeader(const char* gcodePath, const GCodeModule& module, GCodeCacheHeader& header)
+{
+    struct stat st;
+    if (stat(gcodePath, &st) == -1)
+    {
+        return false;
+    }
+
+    MappedFile file;
+    if (!file.Open(gcodePath))
+    {
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = GCODE_CACHE_VERSION;
+    header.pointSize = sizeof(GCodePoint);
+    header.pathSize = sizeof(GCodePath);
+    header.pathStateSize = sizeof(GCodePathState);
+    header.arcChordTolerance = module.GetArcChordTolerance();
+    header.fileSize = (uint64_t)st.st_size;
+    header.fileMTimeSec = (int64_t)st.st_mtim.tv_sec;
+    header.fileMTimeNsec = (int64_t)st.st_mtim.tv_nsec;
+    header.contentHash = HashContent(file.View());
+    return true;
+}
+
+bool GCodeCache::Load(const char* gcodePath, GCodeModule& module)
+{
+    GCodeCacheHeader expected;
+    if (!FillHeader(gcodePath, module, expected))
+    {
+        return false;
+    }
+
+    MappedFile cache;
+    if (!cache.Open(GetCachePath(gcodePath).c_str()) || cache.Size() < sizeof(GCodeCacheHeader))
+    {
+        return false;
+    }
+
+    GCodeCacheHeader header;
+    memcpy(&header, cache.Data(), sizeof(header));
+
+    if (memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+        header.version != expected.version ||
+        header.pointSize != expected.pointSize ||
+        header.pathSize != expected.pathSize ||
+        header.pathStateSize != expected.pathStateSize ||
+        header.arcChordTolerance != expected.arcChordTolerance ||
+        header.fileSize != expected.fileSize ||
+        header.fileMTimeSec != expected.fileMTimeSec ||
+        header.fileMTimeNsec != expected.fileMTimeNsec ||
+        header.contentHash != expected.contentHash)
+    {
+        printf("GCode cache is stale, reparsing: %s\n", gcodePath);
+        return false;
+    }
+
+    size_t pointBytes = header.pointCount * sizeof(GCodePoint);
+    size_t pathBytes = header.pathCount * sizeof(GCodePath);
+    size_t pathStateBytes = header.pathStateCount * sizeof(GCodePathState);
+    size_t layerBytes = header.layerCount * sizeof(GCodeLayerBoundary);
+    if (cache.Size() != sizeof(GCodeCacheHeader) + pointBytes + pathBytes + pathStateBytes + layerBytes)
+    {
+        printf("GCode cache is truncated, reparsing: %s\n", gcodePath);
+        return false;
+    }
+
+    const char* data = cache.Data() + sizeof(GCodeCacheHeader);
+
+    module.points.resize(header.pointCount);
+    memcpy(module.points.data(), data, pointBytes);
+    data += pointBytes;
+
+    module.paths.resize(header.pathCount);
+    memcpy(module.paths.data(), data, pathBytes);
+    data += pathBytes;
+
+    module.pathStates.resize(header.pathStateCount);
+    memcpy(module.pathStates.data(), data, pathStateBytes);
+    data += pathStateBytes;
+
+    module.layerBoundaries.resize(header.layerCount);
+    memcpy(module.layerBoundaries.data(), data, layerBytes);
+
+    return true;
+}
+
+bool GCodeCache::Save(const char* gcodePath, const GCodeModule& module)
+{
+    GCodeCacheHeader header;
+    if (!FillHeader(gcodePath, module, header))
+    {
+        return false;
+    }
+    header.pointCount = module.points.size();
+    header.pathCount = module.paths.size();
+    header.pathStateCount = module.pathStates.size();
+    header.layerCount = module.layerBoundaries.size();
+
+    // Write next to the final file and rename, readers never see a partial cache
+    std::string cachePath = GetCachePath(gcodePath);
+    std::string tempPath = cachePath + ".tmp";
+
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (file == nullptr)
+    {
+        printf("Failed to open GCode cache for writing: %s\n", tempPath.c_str());
+        return false;
+    }
+
+    bool written =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(module.points.data(), sizeof(GCodePoint), module.points.size(), file) == module.points.size() &&
+        fwrite(module.paths.data(), sizeof(GCodePath), module.paths.size(), file) == module.paths.size() &&
+        fwrite(module.pathStates.data(), sizeof(GCodePathState), module.pathStates.size(), file) == module.pathStates.size() &&
+        fwrite(module.layerBoundaries.data(), sizeof(GCodeLayerBoundary), module.layerBoundaries.size(), file) == module.layerBoundaries.size();
+
+    if (fclose(file) != 0 || !written || rename(tempPath.c_str(), cachePath.c_str()) != 0)
+    {
+        printf("Failed to write GCode cache: %s\n", cachePath.c_str());
+        remove(tempPath.c_str());
+        return false;
+    }
+
+    printf("Saved GCode cache: %s\n", cachePath.c_str());
+    return true;
+}
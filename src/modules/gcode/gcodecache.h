@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#define GCODE_CACHE_EXTENSION ".rgc"
+// 3: arcs are tessellated, keyed by the chord tolerance
+#define GCODE_CACHE_VERSION 3
+
+// Number and size of the blocks sampled for the content hash
+#define GCODE_CACHE_HASH_SAMPLES 64
+#define GCODE_CACHE_HASH_BLOCK 4096
+
+class GCodeModule;
+
+struct GCodeCacheHeader{
+    char magic[4];
+    uint32_t version;
+    uint32_t pointSize;
+    uint32_t pathSize;
+    uint32_t pathStateSize;
+    // Arcs were tessellated with this tolerance, it follows the nozzle diameter
+    float arcChordTolerance;
+    uint64_t fileSize;
+    int64_t fileMTimeSec;
+    int64_t fileMTimeNsec;
+    uint64_t contentHash;
+    uint64_t pointCount;
+    uint64_t pathCount;
+    uint64_t pathStateCount;
+    uint64_t layerCount;
+};
+
+// Binary sidecar file holding the interpreted toolpaths of a G-code file,
+// stored next to it as "<file>.rgc". It is keyed by the size, mtime and a
+// content hash of the source and the arc chord tolerance, any mismatch is
+// treated as a cache miss.
+class GCodeCache{
+public:
+    static std::string GetCachePath(const char* gcodePath);
+
+    static bool Load(const char* gcodePath, GCodeModule& module);
+    static bool Save(const char* gcodePath, const GCodeModule& module);
+
+    // Hashes the whole text when small, a fixed set of sampled blocks otherwise
+    static uint64_t HashContent(std::string_view text);
+
+private:
+    static bool FillHeader(const char* gcodePath, const GCodeModule& module, GCodeCacheHeader& header);
+};
@@ -0,0 +1,377 @@
+#include "gcodelexer.h"
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LEXER_X86
+#include <immintrin.h>
+#endif
+
+// Scalar classifiers, also the reference for the vector paths
+
+static void ScalarLineMasks(const char* block, uint64_t& stop, uint64_t& gm)
+{
+    stop = 0;
+    gm = 0;
+    for (int i = 0; i < LEXER_BLOCK_SIZE; i++)
+    {
+        char c = block[i];
+        stop |= (uint64_t)(c == '\n' || c == ';' || c == '\r') << i;
+        gm |= (uint64_t)(c == 'G' || c == 'M') << i;
+    }
+}
+
+static void ScalarWordMasks(const char* block, uint64_t& upper, uint64_t& blank)
+{
+    upper = 0;
+    blank = 0;
+    for (int i = 0; i < LEXER_BLOCK_SIZE; i++)
+    {
+        char c = block[i];
+        upper |= (uint64_t)(c >= 'A' && c <= 'Z') << i;
+        blank |= (uint64_t)(c == ' ' || c == '\t') << i;
+    }
+}
+
+static void ScalarNewLineMask(const char* block, uint64_t& newLine, uint64_t& unused)
+{
+    newLine = 0;
+    unused = 0;
+    for (int i = 0; i < LEXER_BLOCK_SIZE; i++)
+    {
+        newLine |= (uint64_t)(block[i] == '\n') << i;
+    }
+}
+
+#ifdef LEXER_X86
+
+// SSE2, 16 bytes per compare
+
+static inline uint64_t SSE2Mask(__m128i v0, __m128i v1, __m128i v2, __m128i v3)
+{
+    return (uint64_t)(uint16_t)_mm_movemask_epi8(v0) |
+           ((uint64_t)(uint16_t)_mm_movemask_epi8(v1) << 16) |
+           ((uint64_t)(uint16_t)_mm_movemask_epi8(v2) << 32) |
+           ((uint64_t)(uint16_t)_mm_movemask_epi8(v3) << 48);
+}
+
+static void SSE2LineMasks(const char* block, uint64_t& stop, uint64_t& gm)
+{
+    __m128i stopV[4], gmV[4];
+    for (int i = 0; i < 4; i++)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(block + i * 16));
+        stopV[i] = _mm_or_si128(_mm_or_si128(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8(';'))),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+        gmV[i] = _mm_or_si128(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('G')),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('M')));
+    }
+    stop = SSE2Mask(stopV[0], stopV[1], stopV[2], stopV[3]);
+    gm = SSE2Mask(gmV[0], gmV[1], gmV[2], gmV[3]);
+}
+
+static void SSE2WordMasks(const char* block, uint64_t& upper, uint64_t& blank)
+{
+    __m128i upperV[4], blankV[4];
+    for (int i = 0; i < 4; i++)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(block + i * 16));
+        // Signed compares, bytes above 0x7f are negative and fall outside the range
+        upperV[i] = _mm_and_si128(
+            _mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+            _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+        blankV[i] = _mm_or_si128(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    }
+    upper = SSE2Mask(upperV[0], upperV[1], upperV[2], upperV[3]);
+    blank = SSE2Mask(blankV[0], blankV[1], blankV[2], blankV[3]);
+}
+
+static void SSE2NewLineMask(const char* block, uint64_t& newLine, uint64_t& unused)
+{
+    __m128i v[4];
+    for (int i = 0; i < 4; i++)
+    {
+        v[i] = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(block + i * 16)), _mm_set1_epi8('\n'));
+    }
+    newLine = SSE2Mask(v[0], v[1], v[2], v[3]);
+    unused = 0;
+}
+
+// AVX2, 32 bytes per compare
+
+__attribute__((target("avx2")))
+static inline uint64_t AVX2Mask(__m256i v0, __m256i v1)
+{
+    return (uint64_t)(uint32_t)_mm256_movemask_epi8(v0) |
+           ((uint64_t)(uint32_t)_mm256_movemask_epi8(v1) << 32);
+}
+
+__attribute__((target("avx2")))
+static void AVX2LineMasks(const char* block, uint64_t& stop, uint64_t& gm)
+{
+    __m256i stopV[2], gmV[2];
+    for (int i = 0; i < 2; i++)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(block + i * 32));
+        stopV[i] = _mm256_or_si256(_mm256_or_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';'))),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+        gmV[i] = _mm256_or_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('G')),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('M')));
+    }
+    stop = AVX2Mask(stopV[0], stopV[1]);
+    gm = AVX2Mask(gmV[0], gmV[1]);
+}
+
+__attribute__((target("avx2")))
+static void AVX2WordMasks(const char* block, uint64_t& upper, uint64_t& blank)
+{
+    __m256i upperV[2], blankV[2];
+    for (int i = 0; i < 2; i++)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(block + i * 32));
+        upperV[i] = _mm256_and_si256(
+            _mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+        blankV[i] = _mm256_or_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    }
+    upper = AVX2Mask(upperV[0], upperV[1]);
+    blank = AVX2Mask(blankV[0], blankV[1]);
+}
+
+__attribute__((target("avx2")))
+static void AVX2NewLineMask(const char* block, uint64_t& newLine, uint64_t& unused)
+{
+    __m256i v[2];
+    for (int i = 0; i < 2; i++)
+    {
+        v[i] = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(block + i * 32)), _mm256_set1_epi8('\n'));
+    }
+    newLine = AVX2Mask(v[0], v[1]);
+    unused = 0;
+}
+
+#endif
+
+static std::atomic<GCodeLexerISA> selectedISA{GCodeLexer::DetectISA()};
+
+GCodeLexerISA GCodeLexer::DetectISA()
+{
+#ifdef LEXER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return GCodeLexerISA::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return GCodeLexerISA::SSE2;
+    }
+#endif
+    return GCodeLexerISA::SCALAR;
+}
+
+bool GCodeLexer::IsSupported(GCodeLexerISA isa)
+{
+    return (int)isa <= (int)DetectISA();
+}
+
+GCodeLexerISA GCodeLexer::GetISA()
+{
+    return selectedISA.load(std::memory_order_relaxed);
+}
+
+void GCodeLexer::SetISA(GCodeLexerISA isa)
+{
+    if (!IsSupported(isa))
+    {
+        isa = DetectISA();
+    }
+    selectedISA.store(isa, std::memory_order_relaxed);
+}
+
+const char* GCodeLexer::GetISAName(GCodeLexerISA isa)
+{
+    switch (isa)
+    {
+    case GCodeLexerISA::AVX2:
+        return "AVX2";
+    case GCodeLexerISA::SSE2:
+        return "SSE2";
+    default:
+        return "Scalar";
+    }
+}
+
+const GCodeLexer::Classifiers& GCodeLexer::Current()
+{
+    static const Classifiers scalar = {ScalarLineMasks, ScalarWordMasks, ScalarNewLineMask};
+#ifdef LEXER_X86
+    static const Classifiers sse2 = {SSE2LineMasks, SSE2WordMasks, SSE2NewLineMask};
+    static const Classifiers avx2 = {AVX2LineMasks, AVX2WordMasks, AVX2NewLineMask};
+
+    switch (GetISA())
+    {
+    case GCodeLexerISA::AVX2:
+        return avx2;
+    case GCodeLexerISA::SSE2:
+        return sse2;
+    default:
+        break;
+    }
+#endif
+    return scalar;
+}
+
+const char* GCodeLexer::FindNewLine(const char* p, const char* end)
+{
+    alignas(LEXER_BLOCK_SIZE) char pad[LEXER_BLOCK_SIZE];
+    GCodeBlockClassifier classify = Current().newLine;
+
+    while (p < end)
+    {
+        const char* block;
+        size_t count;
+        uint64_t valid = LoadBlock(p, end, pad, block, count);
+
+        uint64_t newLine, unused;
+        classify(block, newLine, unused);
+        newLine &= valid;
+        if (newLine != 0)
+        {
+            return p + __builtin_ctzll(newLine);
+        }
+        p += count;
+    }
+    return nullptr;
+}
+
+std::string_view GCodeLexer::NextProgram(std::string_view& text)
+{
+    alignas(LEXER_BLOCK_SIZE) char pad[LEXER_BLOCK_SIZE];
+    GCodeBlockClassifier classify = Current().line;
+
+    const char* p = text.data();
+    const char* end = p + text.size();
+    const char* programBegin = nullptr;
+    const char* programEnd = end;
+
+    while (p < end)
+    {
+        const char* block;
+        size_t count;
+        uint64_t valid = LoadBlock(p, end, pad, block, count);
+
+        uint64_t stop, gm;
+        classify(block, stop, gm);
+        stop &= valid;
+        gm &= valid;
+
+        if (stop != 0)
+        {
+            // Only G/M words in front of the first stop belong to the program
+            gm &= (stop & (0 - stop)) - 1;
+        }
+        if (programBegin == nullptr && gm != 0)
+        {
+            programBegin = p + __builtin_ctzll(gm);
+        }
+        if (stop != 0)
+        {
+            programEnd = p + __builtin_ctzll(stop);
+            break;
+        }
+        p += count;
+    }
+
+    // Skip the rest of the line, comments run up to the new line
+    const char* next = end;
+    if (programEnd < end)
+    {
+        const char* newLine = *programEnd == '\n' ? programEnd : FindNewLine(programEnd, end);
+        next = newLine ? newLine + 1 : end;
+    }
+    text = std::string_view(next, (size_t)(end - next));
+
+    if (programBegin == nullptr)
+    {
+        return std::string_view();
+    }
+    return std::string_view(programBegin, (size_t)(programEnd - programBegin));
+}
+
+std::string_view GCodeLexer::NextLine(std::string_view& text)
+{
+    const char* end = text.data() + text.size();
+    const char* newLine = FindNewLine(text.data(), end);
+    size_t length = newLine ? (size_t)(newLine - text.data()) : text.size();
+
+    std::string_view line = text.substr(0, length);
+    text.remove_prefix(newLine ? length + 1 : length);
+    return line;
+}
+
+bool GCodeLexer::ParseDecimal(std::string_view token, float& value)
+{
+    // Every power up to 1e10 is exact in a float (5^10 < 2^24)
+    static const float POW10[] = {
+        1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+    };
+
+    const char* p = token.data();
+    const char* end = p + token.size();
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int fraction = 0;
+    while (p < end && (unsigned)(*p - '0') < 10)
+    {
+        mantissa = mantissa * 10 + (unsigned)(*p - '0');
+        digits++;
+        p++;
+    }
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && (unsigned)(*p - '0') < 10)
+        {
+            mantissa = mantissa * 10 + (unsigned)(*p - '0');
+            digits++;
+            fraction++;
+            p++;
+        }
+    }
+
+    // Exponents, non-numbers and more than 15 digits (the mantissa could overflow) take the slow path
+    if (digits == 0 || digits > 15 || (p < end && (*p == 'e' || *p == 'E')))
+    {
+        return false;
+    }
+    // So does a mantissa a float cannot hold exactly, dividing in double and
+    // narrowing to float would round twice
+    if (mantissa > (1u << 24) || fraction > 10)
+    {
+        return false;
+    }
+
+    // Both operands are exact floats, the quotient is correctly rounded
+    float result = (float)mantissa / POW10[fraction];
+    value = negative ? -result : result;
+    return true;
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// Bytes classified per call, SSE2 uses four loads and AVX2 two
+#define LEXER_BLOCK_SIZE 64
+
+enum class GCodeLexerISA{
+    SCALAR = 0,
+    SSE2 = 1,
+    AVX2 = 2
+};
+
+// Block classifier: fills two bitmasks for LEXER_BLOCK_SIZE readable bytes
+using GCodeBlockClassifier = void (*)(const char* block, uint64_t& first, uint64_t& second);
+
+// Vectorized scanning for the G-code reader. Text is classified a block at a
+// time into bitmasks (line terminators, comments, G/M words, word letters,
+// blanks) which are then walked with bit tricks instead of branching on
+// every character. The instruction set is picked at startup and can be
+// overridden, all paths produce identical results.
+class GCodeLexer{
+public:
+    static GCodeLexerISA DetectISA();
+    static bool IsSupported(GCodeLexerISA isa);
+    static GCodeLexerISA GetISA();
+    static void SetISA(GCodeLexerISA isa);
+    static const char* GetISAName(GCodeLexerISA isa);
+
+    // Returns the program part of the next line (first G/M word up to a
+    // comment or line end, empty if none) and advances text past the line
+    static std::string_view NextProgram(std::string_view& text);
+    // Returns the next line without its terminator and advances text past it
+    static std::string_view NextLine(std::string_view& text);
+
+    // Calls fn for each word, words start at upper case letters or after
+    // blanks. An E between a digit and a sign or digit is an exponent and
+    // stays in its word, so X1.5E-3 is one word
+    template<typename F>
+    static void ForEachWord(std::string_view program, F&& fn);
+
+    // Fixed-point fast path for plain decimals, false if the token needs a full parser
+    static bool ParseDecimal(std::string_view token, float& value);
+
+private:
+    struct Classifiers{
+        GCodeBlockClassifier line;    // stop (\n ; \r), G/M
+        GCodeBlockClassifier word;    // upper case letter, blank
+        GCodeBlockClassifier newLine; // \n
+    };
+    static const Classifiers& Current();
+
+    static const char* FindNewLine(const char* p, const char* end);
+
+    static bool IsExponent(const char* p, const char* end){
+        auto isDigit = [](char c) { return c >= '0' && c <= '9'; };
+        return *p == 'E' && isDigit(p[-1]) &&
+            p + 1 < end && (isDigit(p[1]) || p[1] == '+' || p[1] == '-');
+    }
+
+    // Points block at LEXER_BLOCK_SIZE readable bytes starting at p, copying a
+    // short tail into pad. Returns the mask of valid bytes.
+    static uint64_t LoadBlock(const char* p, const char* end, char* pad, const char*& block, size_t& count){
+        count = (size_t)(end - p);
+        if (count >= LEXER_BLOCK_SIZE) {
+            count = LEXER_BLOCK_SIZE;
+            block = p;
+            return ~0ULL;
+        }
+        memset(pad, 0, LEXER_BLOCK_SIZE);
+        memcpy(pad, p, count);
+        block = pad;
+        return (1ULL << count) - 1;
+    }
+};
+
+template<typename F>
+void GCodeLexer::ForEachWord(std::string_view program, F&& fn)
+{
+    alignas(LEXER_BLOCK_SIZE) char pad[LEXER_BLOCK_SIZE];
+    GCodeBlockClassifier classify = Current().word;
+
+    const char* p = program.data();
+    const char* end = p + program.size();
+    const char* wordStart = nullptr;
+    uint64_t previousBlank = 1; // Start of the program acts like a blank
+
+    while (p < end)
+    {
+        const char* block;
+        size_t count;
+        uint64_t valid = LoadBlock(p, end, pad, block, count);
+
+        uint64_t upper, blank;
+        classify(block, upper, blank);
+        blank &= valid;
+        uint64_t nonBlank = ~blank & valid;
+        uint64_t afterBlank = (blank << 1) | previousBlank;
+
+        uint64_t starts = (upper | (nonBlank & afterBlank)) & nonBlank;
+        uint64_t ends = blank & ~afterBlank;
+
+        // Letters inside a token are rare, check those for exponents one by one
+        for (uint64_t inner = starts & ~afterBlank; inner != 0; inner &= inner - 1)
+        {
+            int i = __builtin_ctzll(inner);
+            if (IsExponent(p + i, end))
+            {
+                starts &= ~(1ULL << i);
+            }
+        }
+
+        for (uint64_t events = starts | ends; events != 0; events &= events - 1)
+        {
+            int i = __builtin_ctzll(events);
+            if (wordStart != nullptr)
+            {
+                fn(std::string_view(wordStart, (size_t)(p + i - wordStart)));
+            }
+            wordStart = ((starts >> i) & 1) ? p + i : nullptr;
+        }
+
+        previousBlank = (blank >> (count - 1)) & 1;
+        p += count;
+    }
+
+    if (wordStart != nullptr)
+    {
+        fn(std::string_view(wordStart, (size_t)(end - wordStart)));
+    }
+}
@@ -0,0 +1,72 @@
+#include "gcodequantizer.h"
+
+#include <cmath>
+
+bool GCodeQuantizer::Encode(const std::vector<GCodePoint>& points, GCodeQuantizedPoints& out)
+{
+    out.Clear();
+
+    // A run ends when the height changes or its bounds outgrow what 16 bits
+    // cover at the largest step
+    const float maxExtent = GCODE_QUANT_MAX_STEP * UINT16_MAX;
+    std::vector<uint32_t> runStarts;
+    float minX = 0.0f, maxX = 0.0f, minZ = 0.0f, maxZ = 0.0f;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        const GCodePoint& p = points[i];
+        bool newRun = runStarts.empty() || p.y != out.runs.back().height;
+        if (!newRun)
+        {
+            newRun = std::max(maxX, p.x) - std::min(minX, p.x) > maxExtent ||
+                     std::max(maxZ, p.z) - std::min(minZ, p.z) > maxExtent;
+        }
+
+        if (newRun)
+        {
+            if (!out.runs.empty())
+            {
+                GCodeQuantRun& run = out.runs.back();
+                run.step = std::max(std::max(maxX - minX, maxZ - minZ) / UINT16_MAX, 1e-6f);
+            }
+            if (out.runs.size() == GCODE_QUANT_MAX_RUNS)
+            {
+                out.Clear();
+                return false;
+            }
+            runStarts.push_back((uint32_t)i);
+            out.runs.push_back({p.x, p.z, 0.0f, p.y});
+            minX = maxX = p.x;
+            minZ = maxZ = p.z;
+            continue;
+        }
+
+        minX = std::min(minX, p.x);
+        maxX = std::max(maxX, p.x);
+        minZ = std::min(minZ, p.z);
+        maxZ = std::max(maxZ, p.z);
+        out.runs.back().originX = minX;
+        out.runs.back().originZ = minZ;
+    }
+    if (!out.runs.empty())
+    {
+        GCodeQuantRun& run = out.runs.back();
+        run.step = std::max(std::max(maxX - minX, maxZ - minZ) / UINT16_MAX, 1e-6f);
+    }
+    runStarts.push_back((uint32_t)points.size());
+
+    out.coords.resize(points.size() * 2);
+    out.runIndices.resize(points.size());
+    for (size_t r = 0; r + 1 < runStarts.size(); r++)
+    {
+        const GCodeQuantRun& run = out.runs[r];
+        for (uint32_t i = runStarts[r]; i < runStarts[r + 1]; i++)
+        {
+            float qx = std::round((points[i].x - run.originX) / run.step);
+            float qz = std::round((points[i].z - run.originZ) / run.step);
+            out.coords[2 * i] = (uint16_t)std::clamp(qx, 0.0f, (float)UINT16_MAX);
+            out.coords[2 * i + 1] = (uint16_t)std::clamp(qz, 0.0f, (float)UINT16_MAX);
+            out.runIndices[i] = (uint16_t)r;
+        }
+    }
+    return true;
+}
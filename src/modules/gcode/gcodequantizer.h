@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "gcode.h"
+
+// Largest quantization step in mm, points are off by at most half of it
+#define GCODE_QUANT_MAX_STEP 0.002f
+// Runs are addressed with 16 bits per vertex
+#define GCODE_QUANT_MAX_RUNS ((size_t)UINT16_MAX + 1)
+
+// One texel of the run table: the run's XY origin, step and its height
+struct GCodeQuantRun{
+    float originX;
+    float originZ;
+    float step;
+    float height;
+};
+
+// Compressed toolpath vertices. Consecutive points at one height form a run
+// with its own origin and Z, each point only keeps 16-bit X/Y offsets and
+// its run index, 6 bytes instead of 12 for a float vertex. Only the
+// "gcode_quantized" vertex shader decodes them, point i of run r is
+// (originX + coords[2i] * step, height, originZ + coords[2i + 1] * step).
+struct GCodeQuantizedPoints{
+    std::vector<uint16_t> coords; // X and Y (stored on z) per point
+    std::vector<uint16_t> runIndices;
+    std::vector<GCodeQuantRun> runs;
+
+    size_t Size() const {
+        return runIndices.size();
+    }
+
+    void Clear(){
+        coords = std::vector<uint16_t>();
+        runIndices = std::vector<uint16_t>();
+        runs = std::vector<GCodeQuantRun>();
+    }
+};
+
+class GCodeQuantizer{
+public:
+    // Returns false when the points need more runs than a vertex can
+    // address (e.g. spiral vase prints), out is left empty then
+    static bool Encode(const std::vector<GCodePoint>& points, GCodeQuantizedPoints& out);
+};
@@ -0,0 +1,359 @@
+#include "gcodereader.h"
+#include "gcodelexer.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <strings.h>
+
+#include <chrono>
+
+#include <tbb/parallel_for.h>
+
+std::string_view GCodeReader::NextLine(std::string_view& text)
+{
+    return GCodeLexer::NextLine(text);
+}
+
+std::string_view GCodeReader::NextProgram(std::string_view& text)
+{
+    return GCodeLexer::NextProgram(text);
+}
+
+std::string_view GCodeReader::ExtractProgram(std::string_view line)
+{
+    return GCodeLexer::NextProgram(line);
+}
+
+bool GCodeReader::IsLayerComment(std::string_view line)
+{
+    size_t i = line.find_first_not_of(" \t");
+    if (i == std::string_view::npos || line[i] != ';')
+    {
+        return false;
+    }
+
+    // Some slicers write "; layer 12, Z = 0.6", match the keyword case insensitively
+    i = line.find_first_not_of(" \t", i + 1);
+    if (i == std::string_view::npos || line.size() - i < sizeof(GCODE_LAYER_COMMENT) - 1)
+    {
+        return false;
+    }
+    return strncasecmp(line.data() + i, GCODE_LAYER_COMMENT, sizeof(GCODE_LAYER_COMMENT) - 1) == 0;
+}
+
+bool GCodeReader::ParseProgram(std::string_view program, GCodeCommandTable &table)
+{
+    char command = 0;
+    int id = -1; // Default ID
+    size_t offset = table.arguments.size();
+
+    GCodeLexer::ForEachWord(program, [&](std::string_view token) {
+        if (token[0] == 'G' || token[0] == 'M')
+        {
+            command = token[0];
+            id = ParseInt(token.substr(1));
+        }
+        else if (table.arguments.size() - offset < MAX_COMMAND_ARGUMENTS)
+        {
+            GCodeArgument arg;
+            arg.letter = token[0];
+            arg.value = ParseFloat(token.substr(1));
+            table.arguments.push_back(arg);
+        }
+    });
+
+    if (command == 0)
+    {
+        // Drop the arguments of the rejected line
+        table.arguments.resize(offset);
+        return false;
+    }
+
+    table.commands.push_back(command);
+    table.ids.push_back(id);
+    table.argumentOffsets.push_back((uint32_t)offset);
+    table.argumentCounts.push_back((uint16_t)(table.arguments.size() - offset));
+    return true;
+}
+
+void GCodeReader::ParseText(std::string_view text, GCodeCommandTable &table)
+{
+    while (!text.empty())
+    {
+        std::string_view program = NextProgram(text);
+        if (program.empty())
+        {
+            continue;
+        }
+        ParseProgram(program, table);
+    }
+}
+
+std::string_view GCodeReader::NextChunk(std::string_view& text, size_t chunkSize)
+{
+    if (text.size() <= chunkSize)
+    {
+        std::string_view chunk = text;
+        text = std::string_view();
+        return chunk;
+    }
+
+    // Extend the chunk up to the end of the line it stops in
+    const char* newLine = (const char*)memchr(text.data() + chunkSize, '\n', text.size() - chunkSize);
+    size_t length = newLine ? (size_t)(newLine - text.data()) + 1 : text.size();
+
+    std::string_view chunk = text.substr(0, length);
+    text.remove_prefix(length);
+    return chunk;
+}
+
+std::vector<std::string_view> GCodeReader::SplitChunks(std::string_view text, size_t chunkSize)
+{
+    std::vector<std::string_view> chunks;
+    while (!text.empty())
+    {
+        chunks.push_back(NextChunk(text, chunkSize));
+    }
+    return chunks;
+}
+
+void GCodeReader::ParseTextParallel(std::string_view text, GCodeCommandTable &table)
+{
+    std::vector<std::string_view> chunks = SplitChunks(text, PARSE_CHUNK_SIZE);
+    std::vector<GCodeCommandTable> chunkTables(chunks.size());
+
+    // Lines are independent of each other, chunks can be parsed in any order
+    tbb::parallel_for(size_t(0), chunks.size(), [&](size_t i) {
+        ParseText(chunks[i], chunkTables[i]);
+    });
+
+    size_t commandCount = table.Size();
+    size_t argumentCount = table.arguments.size();
+    for (const auto &chunk : chunkTables)
+    {
+        commandCount += chunk.Size();
+        argumentCount += chunk.arguments.size();
+    }
+    table.Reserve(commandCount, argumentCount);
+
+    // Join in file order, releasing each chunk once it is copied
+    for (auto &chunk : chunkTables)
+    {
+        table.Append(chunk);
+        chunk.Clear();
+    }
+}
+
+int GCodeReader::ParseInt(std::string_view token)
+{
+    if (!token.empty() && token[0] == '+')
+    {
+        token.remove_prefix(1);
+    }
+
+    // Behaves like atoi, unparsable input yields 0
+    int value = 0;
+    std::from_chars(token.data(), token.data() + token.size(), value);
+    return value;
+}
+
+float GCodeReader::ParseFloat(std::string_view token)
+{
+    if (!token.empty() && token[0] == '+')
+    {
+        token.remove_prefix(1);
+    }
+
+    float value = 0.0f;
+    if (GCodeLexer::ParseDecimal(token, value))
+    {
+        return value;
+    }
+
+    // Behaves like atof, unparsable input yields 0
+    std::from_chars(token.data(), token.data() + token.size(), value);
+    return value;
+}
+
+void GCodeReader::ParseTextBaseline(std::string_view text, GCodeCommandTable &table)
+{
+    while (!text.empty())
+    {
+        const char* newLine = (const char*)memchr(text.data(), '\n', text.size());
+        size_t length = newLine ? (size_t)(newLine - text.data()) : text.size();
+        std::string_view line = text.substr(0, length);
+        text.remove_prefix(newLine ? length + 1 : length);
+
+        size_t start = std::string_view::npos;
+        size_t end = line.size();
+        for (size_t i = 0; i < line.size(); i++)
+        {
+            char c = line[i];
+            // Comments and carriage returns end the program part of the line
+            if (c == ';' || c == '\r')
+            {
+                end = i;
+                break;
+            }
+            if ((c == 'G' || c == 'M') && start == std::string_view::npos)
+            {
+                start = i;
+            }
+        }
+        if (start == std::string_view::npos)
+        {
+            continue;
+        }
+        std::string_view program = line.substr(start, end - start);
+
+        char command = 0;
+        int id = -1;
+        size_t offset = table.arguments.size();
+        size_t i = 0;
+        while (i < program.size())
+        {
+            // Skip separators
+            while (i < program.size() && (program[i] == ' ' || program[i] == '\t'))
+            {
+                i++;
+            }
+            size_t tokenStart = i;
+            while (i < program.size() && program[i] != ' ' && program[i] != '\t')
+            {
+                i++;
+            }
+            if (tokenStart == i)
+            {
+                break;
+            }
+
+            std::string_view token = program.substr(tokenStart, i - tokenStart);
+            if (token[0] == 'G' || token[0] == 'M')
+            {
+                command = token[0];
+                id = ParseInt(token.substr(1));
+            }
+            else if (table.arguments.size() - offset < MAX_COMMAND_ARGUMENTS)
+            {
+                std::string_view digits = token.substr(1);
+                if (!digits.empty() && digits[0] == '+')
+                {
+                    digits.remove_prefix(1);
+                }
+                GCodeArgument arg;
+                arg.letter = token[0];
+                arg.value = 0.0f;
+                std::from_chars(digits.data(), digits.data() + digits.size(), arg.value);
+                table.arguments.push_back(arg);
+            }
+        }
+
+        if (command == 0)
+        {
+            table.arguments.resize(offset);
+            continue;
+        }
+        table.commands.push_back(command);
+        table.ids.push_back(id);
+        table.argumentOffsets.push_back((uint32_t)offset);
+        table.argumentCounts.push_back((uint16_t)(table.arguments.size() - offset));
+    }
+}
+
+bool GCodeReader::SelfTest()
+{
+    struct Case{
+        const char* line;
+        const char* letters;
+        float values[4];
+    };
+    const Case cases[] = {
+        {"G1 X1.5E-3 Y2", "XY", {1.5e-3f, 2.0f}},
+        {"G1 X2E+2 E0.5", "XE", {200.0f, 0.5f}},
+        {"G1X10Y5.E0.5", "XYE", {10.0f, 5.0f, 0.5f}},
+        {"G1 X-1e3 E-0.8 ; E1", "XE", {-1000.0f, -0.8f}},
+    };
+
+    bool passed = true;
+    GCodeLexerISA selected = GCodeLexer::GetISA();
+    const GCodeLexerISA isas[] = {GCodeLexerISA::SCALAR, GCodeLexerISA::SSE2, GCodeLexerISA::AVX2};
+    for (GCodeLexerISA isa : isas)
+    {
+        if (!GCodeLexer::IsSupported(isa))
+        {
+            continue;
+        }
+        GCodeLexer::SetISA(isa);
+
+        for (const Case& c : cases)
+        {
+            GCodeCommandTable table;
+            ParseText(c.line, table);
+
+            size_t count = strlen(c.letters);
+            bool match = table.Size() == 1 && table.argumentCounts[0] == count;
+            for (size_t i = 0; match && i < count; i++)
+            {
+                const GCodeArgument& arg = table.arguments[table.argumentOffsets[0] + i];
+                match = arg.letter == c.letters[i] && fabsf(arg.value - c.values[i]) <= 1e-6f * fmaxf(1.0f, fabsf(c.values[i]));
+            }
+            if (!match)
+            {
+                printf("Lexer self test failed with %s on \"%s\"\n", GCodeLexer::GetISAName(isa), c.line);
+                passed = false;
+            }
+        }
+    }
+
+    GCodeLexer::SetISA(selected);
+    return passed;
+}
+
+void GCodeReader::BenchmarkLexers(std::string_view text)
+{
+    GCodeLexerISA selected = GCodeLexer::GetISA();
+    if (!SelfTest())
+    {
+        printf("Lexer self test failed, timings below compare diverging parsers\n");
+    }
+    printf("Lexer benchmark over %.1f MB, runtime selection: %s\n", text.size() / (1024.0 * 1024.0), GCodeLexer::GetISAName(selected));
+
+    // The old loop is the reference for speed and command count. Scalar is the
+    // lexer's own fallback, not that loop
+    size_t referenceCount = 0;
+    double referenceTime = 0.0;
+    {
+        GCodeCommandTable table;
+        auto start = std::chrono::steady_clock::now();
+        ParseTextBaseline(text, table);
+        auto end = std::chrono::steady_clock::now();
+        referenceTime = std::chrono::duration<double>(end - start).count();
+        referenceCount = table.Size();
+        printf("  %-6s %8.3f s %8.1f MB/s  x1.00  %zu commands\n",
+            "loop", referenceTime, text.size() / (1024.0 * 1024.0) / referenceTime, referenceCount);
+    }
+
+    const GCodeLexerISA isas[] = {GCodeLexerISA::SCALAR, GCodeLexerISA::SSE2, GCodeLexerISA::AVX2};
+    for (GCodeLexerISA isa : isas)
+    {
+        if (!GCodeLexer::IsSupported(isa))
+        {
+            printf("  %-6s not supported on this CPU\n", GCodeLexer::GetISAName(isa));
+            continue;
+        }
+        GCodeLexer::SetISA(isa);
+
+        GCodeCommandTable table;
+        auto start = std::chrono::steady_clock::now();
+        ParseText(text, table);
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+
+        printf("  %-6s %8.3f s %8.1f MB/s  x%.2f  %zu commands%s\n",
+            GCodeLexer::GetISAName(isa), seconds, text.size() / (1024.0 * 1024.0) / seconds,
+            referenceTime / seconds, table.Size(), table.Size() == referenceCount ? "" : " (MISMATCH)");
+    }
+
+    GCodeLexer::SetISA(selected);
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <string_view>
+#include <vector>
+
+#include "gcode.h"
+
+#define PARSE_CHUNK_SIZE ((size_t)8 * 1024 * 1024)
+#define STREAM_CHUNK_SIZE ((size_t)1024 * 1024)
+
+// Keyword of the layer change comments written by slicers
+#define GCODE_LAYER_COMMENT "LAYER"
+
+// Zero-copy G-code parser. Works directly on the mapped file text, every
+// token is a view into it so there is no line length limit.
+class GCodeReader{
+public:
+    // Pops the next line from text, without its line terminator
+    static std::string_view NextLine(std::string_view& text);
+
+    // Pops the program part of the next line, see GCodeLexer::NextProgram
+    static std::string_view NextProgram(std::string_view& text);
+
+    // Strips comments and returns the line starting from the first G/M word
+    static std::string_view ExtractProgram(std::string_view line);
+
+    // True for slicer layer markers such as ";LAYER:12" or ";LAYER_CHANGE"
+    static bool IsLayerComment(std::string_view line);
+
+    // Appends the parsed command to the table, returns false if the program has no G/M word
+    static bool ParseProgram(std::string_view program, GCodeCommandTable& table);
+    static void ParseText(std::string_view text, GCodeCommandTable& table);
+
+    // Pops a chunk of roughly chunkSize bytes ending on a line boundary
+    static std::string_view NextChunk(std::string_view& text, size_t chunkSize);
+    // Splits text into chunks of roughly chunkSize bytes ending on line boundaries
+    static std::vector<std::string_view> SplitChunks(std::string_view text, size_t chunkSize);
+    // Parses chunks concurrently, output order matches ParseText
+    static void ParseTextParallel(std::string_view text, GCodeCommandTable& table);
+
+    static int ParseInt(std::string_view token);
+    static float ParseFloat(std::string_view token);
+
+    // The byte-at-a-time parser the lexer replaced, kept as the benchmark baseline
+    static void ParseTextBaseline(std::string_view text, GCodeCommandTable& table);
+
+    // Parses fixed lines (exponents, packed words) with every lexer path the
+    // CPU supports and checks the arguments, false on any mismatch
+    static bool SelfTest();
+
+    // Times ParseTextBaseline and ParseText with every lexer path the CPU supports
+    static void BenchmarkLexers(std::string_view text);
+};
@@ -1,6 +1,14 @@
 #include "layermapper.h"
 
 #include "../gcode/gcode.h"
+#include "pathsimplifier.h"
+#include "pointhashset.h"
+#include "polygonunion.h"
+
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_invoke.h>
+
+#include <chrono>
 
 LayerMapper::LayerMapper() {
     Set2DNozzlePolygon(0.46f);
@@ -49,69 +57,333 @@ Polygon_2 LayerMapper::place_nozzle_at(Polygon_2 nozzle, Point_2 vertex) {
     return translated_nozzle;
 }
 
-std::vector<Polygon_with_holes_2> LayerMapper::GCodePathsToPolygons(std::vector<GCodePoint> points, std::vector<GCodePath> paths)
+std::vector<LayerPolyline> LayerMapper::BuildLayerLines(const std::vector<GCodePoint>& points, const std::vector<GCodePath>& paths, std::span<const uint32_t> layerPaths)
 {
-    double thickness = nozzle.diameter;
-    double half_w = thickness / 2.0;
+    std::vector<LayerPolyline> lines = PathSimplifier::BuildPolylines(points, paths, layerPaths);
+    if (simplify_paths) {
+        float tolerance = nozzle.diameter * simplify_tolerance;
+        for (auto &line : lines) {
+            PathSimplifier::Simplify(line, tolerance);
+        }
+    }
+    return lines;
+}
 
-    std::unordered_set<std::string> unique_points;
-    std::vector<Polygon_2> polygons;
-    int pi = 0;
-    for (const auto &path : paths) {
-        GCodePoint p1 = points[path.start];
-        GCodePoint p2 = points[path.end];
+std::vector<Polygon_with_holes_2> LayerMapper::GCodePathsToPolygons(const std::vector<GCodePoint>& points, const std::vector<GCodePath>& paths, std::span<const uint32_t> layerPaths)
+{
+    return LinesToPolygons(BuildLayerLines(points, paths, layerPaths));
+}
 
-        // Create path vector
-        Vector_2 direction(Point_2(p1.x, p1.z), Point_2(p2.x, p2.z));
-        
-        // Zero-length Check
-        if (direction.squared_length() == 0) continue;
+std::vector<Polygon_with_holes_2> LayerMapper::LinesToPolygons(const std::vector<LayerPolyline>& lines)
+{
+    std::vector<Polygon_with_holes_2> final_output;
+    if (unionBackend == UNION_FAST) {
+        // Bead outlines overlap themselves, only the winding based sweep can take them
+        std::vector<UnionRing> footprints = bead_footprints ? BeadFootprints(lines) : SegmentFootprints(lines);
+        if (UnionFootprints(footprints, UNION_FAST, final_output)) {
+            return final_output;
+        }
+        printf("Fast polygon union could not resolve a degenerate layer, using the exact union.\n");
+    }
 
-        // Normal vector
-        double len = std::sqrt(CGAL::to_double(direction.squared_length()));
-        Vector_2 normal(-direction.y() * (half_w / len), direction.x() * (half_w / len));
+    UnionFootprints(SegmentFootprints(lines), UNION_EXACT, final_output);
+    return final_output;
+}
 
-        Polygon_2 rect;
-        Point_2 a(p1.x + CGAL::to_double(normal.x()), p1.z + CGAL::to_double(normal.y()));
-        Point_2 b(p2.x + CGAL::to_double(normal.x()), p2.z + CGAL::to_double(normal.y()));
-        Point_2 c(p2.x - CGAL::to_double(normal.x()), p2.z - CGAL::to_double(normal.y()));
-        Point_2 d(p1.x - CGAL::to_double(normal.x()), p1.z - CGAL::to_double(normal.y()));
+std::vector<UnionRing> LayerMapper::SegmentFootprints(const std::vector<LayerPolyline>& lines)
+{
+    double half_w = nozzle.diameter / 2.0;
 
-        rect.push_back(a);
-        rect.push_back(b);
-        rect.push_back(c);
-        rect.push_back(d);
+    UnionRing nozzle_ring;
+    for (const auto &pt : nozzle.polygon.vertices()) {
+        nozzle_ring.push_back({CGAL::to_double(pt.x()), CGAL::to_double(pt.y())});
+    }
+    auto place_nozzle_ring = [&nozzle_ring](LayerPoint center) {
+        UnionRing ring(nozzle_ring);
+        for (auto &p : ring) {
+            p.x += center.x;
+            p.y += center.y;
+        }
+        return ring;
+    };
 
-        // Ensure the polygon is oriented counter-clockwise for the Polygon_set_2
-        if (rect.is_clockwise_oriented()) rect.reverse_orientation();
-        
-        polygons.push_back(rect);
-        pi++;
+    PointHashSet unique_points(NOZZLE_MERGE_TOLERANCE);
+    std::vector<UnionRing> footprints;
+    for (const auto &line : lines) {
+        for (size_t k = 0; k + 1 < line.size(); k++) {
+            LayerPoint p1 = line[k];
+            LayerPoint p2 = line[k + 1];
 
-        if(unique_points.find(std::to_string(p1.x) + "," + std::to_string(p1.z)) == unique_points.end()) {
-            Polygon_2 nozzle_start = place_nozzle_at(nozzle.polygon, Point_2(p1.x, p1.z));
-            polygons.push_back(nozzle_start);
-            pi++;
-            unique_points.insert(std::to_string(p1.x) + "," + std::to_string(p1.z));
-        }
-        if(unique_points.find(std::to_string(p2.x) + "," + std::to_string(p2.z)) == unique_points.end()) {
-            Polygon_2 nozzle_end =  place_nozzle_at(nozzle.polygon, Point_2(p2.x, p2.z));
-            polygons.push_back(nozzle_end);
-            pi++;
-            unique_points.insert(std::to_string(p2.x) + "," + std::to_string(p2.z));
-        }
+            // Create path vector
+            double dx = (double)p2.x - p1.x;
+            double dy = (double)p2.y - p1.y;
+
+            // Zero-length Check
+            if (dx == 0 && dy == 0) continue;
+
+            // Normal vector
+            double len = std::sqrt(dx * dx + dy * dy);
+            double nx = -dy * (half_w / len);
+            double ny = dx * (half_w / len);
 
+            // Counter-clockwise, the normal points to the left of the path
+            footprints.push_back({
+                {p1.x - nx, p1.y - ny},
+                {p2.x - nx, p2.y - ny},
+                {p2.x + nx, p2.y + ny},
+                {p1.x + nx, p1.y + ny}
+            });
+
+            if(unique_points.Insert(p1.x, p1.y)) {
+                footprints.push_back(place_nozzle_ring(p1));
+            }
+            if(unique_points.Insert(p2.x, p2.y)) {
+                footprints.push_back(place_nozzle_ring(p2));
+            }
+
+        }
     }
 
     /*
-    printf("Generated %d polygons from paths and nozzles.\n", pi);
-    printf("Total polygons count: %lu\n", polygons.size());
+    printf("Total footprint count: %lu\n", footprints.size());
     */
 
+    return footprints;
+}
+
+std::vector<UnionRing> LayerMapper::BeadFootprints(const std::vector<LayerPolyline>& lines)
+{
+    double radius = nozzle.diameter / 2.0;
+    // Arcs use the angular step of the nozzle polygon
+    double step = 2.0 * CGAL_PI / std::max<size_t>(nozzle.polygon.size(), 8);
+
+    std::vector<UnionRing> footprints;
+    footprints.reserve(lines.size());
+    std::vector<LayerPoint> route;
+    for (const auto &line : lines) {
+        // The outline follows the right side out and back, the turn at each end becomes its cap
+        route.clear();
+        for (const auto &p : line) {
+            if (route.empty() || p.x != route.back().x || p.y != route.back().y) {
+                route.push_back(p);
+            }
+        }
+        if (route.empty()) continue;
+        for (size_t k = route.size() - 1; k-- > 1;) {
+            route.push_back(route[k]);
+        }
+
+        UnionRing ring;
+        auto add_arc = [&](const LayerPoint &center, double from, double sweep) {
+            int steps = std::max(1, (int)std::ceil(sweep / step - 1e-9));
+            for (int j = 0; j <= steps; j++) {
+                double angle = from + sweep * j / steps;
+                ring.push_back({center.x + radius * std::cos(angle), center.y + radius * std::sin(angle)});
+            }
+        };
+
+        if (route.size() == 1) {
+            add_arc(route[0], 0.0, 2.0 * CGAL_PI - step);
+            footprints.push_back(std::move(ring));
+            continue;
+        }
+
+        size_t count = route.size();
+        for (size_t k = 0; k < count; k++) {
+            const LayerPoint &prev = route[(k + count - 1) % count];
+            const LayerPoint &p = route[k];
+            const LayerPoint &next = route[(k + 1) % count];
+            double in_x = (double)p.x - prev.x, in_y = (double)p.y - prev.y;
+            double out_x = (double)next.x - p.x, out_y = (double)next.y - p.y;
+
+            // Right hand normals of the incoming and outgoing segment
+            double in_angle = std::atan2(-in_x, in_y);
+            double out_angle = std::atan2(-out_x, out_y);
+            double cross = in_x * out_y - in_y * out_x;
+            double dot = in_x * out_x + in_y * out_y;
+
+            if (cross < 0.0) {
+                // Turning right puts the join inside, the loop through the vertex has positive winding
+                ring.push_back({p.x + radius * std::cos(in_angle), p.y + radius * std::sin(in_angle)});
+                ring.push_back({(double)p.x, (double)p.y});
+                ring.push_back({p.x + radius * std::cos(out_angle), p.y + radius * std::sin(out_angle)});
+            } else if (cross == 0.0 && dot > 0.0) {
+                ring.push_back({p.x + radius * std::cos(in_angle), p.y + radius * std::sin(in_angle)});
+            } else {
+                double sweep = out_angle - in_angle;
+                if (sweep <= 0.0) sweep += 2.0 * CGAL_PI;
+                add_arc(p, in_angle, sweep);
+            }
+        }
+        footprints.push_back(std::move(ring));
+    }
+    return footprints;
+}
+
+static Polygon_2 RingToPolygon(const UnionRing& ring)
+{
+    Polygon_2 polygon;
+    for (const auto &p : ring) {
+        polygon.push_back(Point_2(p.x, p.y));
+    }
+    return polygon;
+}
+
+static std::vector<Polygon_with_holes_2> ToPolygonsWithHoles(const std::vector<UnionPolygon>& merged)
+{
+    std::vector<Polygon_with_holes_2> final_output;
+    final_output.reserve(merged.size());
+    for (const auto &merged_polygon : merged) {
+        std::vector<Polygon_2> holes;
+        for (const auto &hole : merged_polygon.holes) {
+            holes.push_back(RingToPolygon(hole));
+        }
+        final_output.push_back(Polygon_with_holes_2(RingToPolygon(merged_polygon.outer), holes.begin(), holes.end()));
+    }
+    return final_output;
+}
+
+// Merges neighbouring tiles pairwise, halving the longer side of the grid
+// each round, until a single tile holds the whole layer
+template <typename TileResult, typename MergeFunction>
+static void MergeTileGrid(std::vector<TileResult>& tiles, int cols, int rows, MergeFunction merge)
+{
+    while (cols > 1 || rows > 1) {
+        bool along_x = cols >= rows;
+        int new_cols = along_x ? (cols + 1) / 2 : cols;
+        int new_rows = along_x ? rows : (rows + 1) / 2;
+
+        std::vector<TileResult> merged(new_cols * new_rows);
+        tbb::parallel_for(0, (int)merged.size(), [&](int t) {
+            int ax = along_x ? (t % new_cols) * 2 : t % new_cols;
+            int ay = along_x ? t / new_cols : (t / new_cols) * 2;
+            int bx = along_x ? ax + 1 : ax;
+            int by = along_x ? ay : ay + 1;
+
+            TileResult& a = tiles[ay * cols + ax];
+            if (bx >= cols || by >= rows) {
+                merged[t] = std::move(a);
+                return;
+            }
+            merge(a, tiles[by * cols + bx], merged[t]);
+        });
+
+        tiles = std::move(merged);
+        cols = new_cols;
+        rows = new_rows;
+    }
+}
+
+bool LayerMapper::UnionFootprints(const std::vector<UnionRing>& footprints, UnionBackend backend, std::vector<Polygon_with_holes_2>& final_output)
+{
+    if (tile_large_layers && footprints.size() >= UNION_TILE_MIN_FOOTPRINTS) {
+        return UnionFootprintsTiled(footprints, backend, final_output);
+    }
+
+    if (backend == UNION_FAST) {
+        std::vector<UnionPolygon> merged;
+        if (!PolygonUnion::Union(footprints, merged)) {
+            return false;
+        }
+        final_output = ToPolygonsWithHoles(merged);
+        return true;
+    }
+
+    final_output = ExactUnion(footprints);
+    return true;
+}
+
+bool LayerMapper::UnionFootprintsTiled(const std::vector<UnionRing>& footprints, UnionBackend backend, std::vector<Polygon_with_holes_2>& final_output)
+{
+    // Bucket the footprints on a grid by the centre of their bounds
+    std::vector<UnionPoint> centers(footprints.size());
+    double min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+    for (size_t i = 0; i < footprints.size(); i++) {
+        double lo_x = INFINITY, lo_y = INFINITY, hi_x = -INFINITY, hi_y = -INFINITY;
+        for (const auto &p : footprints[i]) {
+            lo_x = std::min(lo_x, p.x);
+            lo_y = std::min(lo_y, p.y);
+            hi_x = std::max(hi_x, p.x);
+            hi_y = std::max(hi_y, p.y);
+        }
+        centers[i] = {(lo_x + hi_x) * 0.5, (lo_y + hi_y) * 0.5};
+        min_x = std::min(min_x, centers[i].x);
+        min_y = std::min(min_y, centers[i].y);
+        max_x = std::max(max_x, centers[i].x);
+        max_y = std::max(max_y, centers[i].y);
+    }
+
+    double width = std::max(max_x - min_x, 1e-3);
+    double height = std::max(max_y - min_y, 1e-3);
+    size_t tile_count = (footprints.size() + UNION_TILE_FOOTPRINTS - 1) / UNION_TILE_FOOTPRINTS;
+    int cols = std::clamp((int)std::round(std::sqrt(tile_count * width / height)), 1, (int)tile_count);
+    int rows = (int)((tile_count + cols - 1) / cols);
+
+    std::vector<std::vector<uint32_t>> tiles(cols * rows);
+    for (size_t i = 0; i < footprints.size(); i++) {
+        int cx = std::min(cols - 1, (int)((centers[i].x - min_x) / width * cols));
+        int cy = std::min(rows - 1, (int)((centers[i].y - min_y) / height * rows));
+        tiles[cy * cols + cx].push_back((uint32_t)i);
+    }
+
+    auto gather = [&](size_t t) {
+        std::vector<UnionRing> rings;
+        rings.reserve(tiles[t].size());
+        for (uint32_t i : tiles[t]) {
+            rings.push_back(footprints[i]);
+        }
+        return rings;
+    };
+
+    if (backend == UNION_FAST) {
+        std::atomic<bool> resolved = true;
+        std::vector<std::vector<UnionPolygon>> results(tiles.size());
+        tbb::parallel_for((size_t)0, tiles.size(), [&](size_t t) {
+            if (!PolygonUnion::Union(gather(t), results[t])) {
+                resolved = false;
+            }
+        });
+        if (resolved) {
+            MergeTileGrid(results, cols, rows, [&](std::vector<UnionPolygon>& a, std::vector<UnionPolygon>& b, std::vector<UnionPolygon>& out) {
+                if (resolved && !PolygonUnion::Merge(a, b, out)) {
+                    resolved = false;
+                }
+            });
+        }
+        if (resolved) {
+            final_output = ToPolygonsWithHoles(results[0]);
+        }
+        return resolved;
+    }
+
+    std::vector<std::vector<Polygon_with_holes_2>> results(tiles.size());
+    tbb::parallel_for((size_t)0, tiles.size(), [&](size_t t) {
+        results[t] = ExactUnion(gather(t));
+    });
+    MergeTileGrid(results, cols, rows, [](std::vector<Polygon_with_holes_2>& a, std::vector<Polygon_with_holes_2>& b, std::vector<Polygon_with_holes_2>& out) {
+        a.insert(a.end(), std::make_move_iterator(b.begin()), std::make_move_iterator(b.end()));
+        Polygon_set_2 merger;
+        merger.join(a.begin(), a.end());
+        merger.polygons_with_holes(std::back_inserter(out));
+    });
+    final_output = std::move(results[0]);
+    return true;
+}
+
+std::vector<Polygon_with_holes_2> LayerMapper::ExactUnion(const std::vector<UnionRing>& footprints)
+{
+    std::vector<Polygon_2> polygons;
+    polygons.reserve(footprints.size());
+    for (const auto &ring : footprints) {
+        Polygon_2 polygon = RingToPolygon(ring);
+        // Ensure the polygon is oriented counter-clockwise for the Polygon_set_2
+        if (polygon.is_clockwise_oriented()) polygon.reverse_orientation();
+        polygons.push_back(polygon);
+    }
+
     Polygon_set_2 merger;
     merger.join(polygons.begin(), polygons.end());
 
-    
     std::vector<Polygon_with_holes_2> final_output;
     merger.polygons_with_holes(std::back_inserter(final_output));
     
@@ -124,13 +396,8 @@ std::vector<Polygon_with_holes_2> LayerMapper::GCodePathsToPolygons(std::vector<
     return final_output;
 }
 
-Mesh LayerMapper::PolygonsLayerToMesh(std::vector<Polygon_with_holes_2>& layer, float layer_height)
+void LayerMapper::TriangulateLayer(const std::vector<Polygon_with_holes_2>& layer, CDT& cdt, std::unordered_map<Face_handle, bool>& in_domain_map)
 {
-    
-    Mesh flat_mesh;
-
-    CDT cdt;
-        
     for (const auto &pwh : layer) {
         cdt.insert_constraint(pwh.outer_boundary().vertices_begin(), 
                             pwh.outer_boundary().vertices_end(), true);
@@ -139,17 +406,26 @@ Mesh LayerMapper::PolygonsLayerToMesh(std::vector<Polygon_with_holes_2>& layer,
             cdt.insert_constraint(i->vertices_begin(), i->vertices_end(), true);
         }
     }
-        std::unordered_map<Face_handle, bool> in_domain_map;
-        boost::associative_property_map< std::unordered_map<Face_handle,bool> >
-            in_domain(in_domain_map);
+    boost::associative_property_map< std::unordered_map<Face_handle,bool> >
+        in_domain(in_domain_map);
 
-    // 3. Mark facets that are inside the domain
+    // Mark facets that are inside the domain
     CGAL::mark_domain_in_triangulation(cdt, in_domain);
+}
+
+Mesh LayerMapper::PolygonsLayerToMesh(std::vector<Polygon_with_holes_2>& layer, float layer_height)
+{
+    
+    Mesh flat_mesh;
+
+    CDT cdt;
+    std::unordered_map<Face_handle, bool> in_domain_map;
+    TriangulateLayer(layer, cdt, in_domain_map);
 
     std::map<CDT::Vertex_handle, Mesh::Vertex_index> v_map;
 
     for(auto f : cdt.finite_face_handles()) {
-        if (get(in_domain, f)) {
+        if (in_domain_map[f]) {
             Mesh::Vertex_index vi[3];
             for(int i=0; i<3; ++i) {
                 auto vh = f->vertex(i);
@@ -181,30 +457,279 @@ Mesh LayerMapper::MergeTwoMesh(Mesh m1, Mesh m2) {
     return result;
 }
 
+// A mesh of the merge tree with the box it occupies, boxes of merged meshes are joined
+struct MergeOperand {
+    Mesh mesh;
+    CGAL::Bbox_3 box;
+};
+
 Mesh LayerMapper::MergeLayersToModel(std::vector<Mesh> layers)
 {
     if (layers.empty()) return Mesh();
 
-    std::deque<Mesh> meshes;
-    for (auto& l : layers) meshes.push_back(std::move(l));
+    std::vector<MergeOperand> operands(layers.size());
+    tbb::parallel_for((size_t)0, layers.size(), [&](size_t i) {
+        operands[i].box = CGAL::Polygon_mesh_processing::bbox(layers[i]);
+        operands[i].mesh = std::move(layers[i]);
+    });
+    layers.clear();
 
-    while (meshes.size() > 1) {
-        std::vector<std::future<Mesh>> futures;
-        
-        while (meshes.size() >= 2) {
-            Mesh m1 = std::move(meshes.front()); meshes.pop_front();
-            Mesh m2 = std::move(meshes.front()); meshes.pop_front();
-            
-            futures.push_back(std::async(std::launch::async, MergeTwoMesh, 
-                            std::move(m1), std::move(m2)));
+    // Pairs are taken from the bottom up, so every union works on touching neighbours
+    std::stable_sort(operands.begin(), operands.end(), [](const MergeOperand& a, const MergeOperand& b) {
+        return a.box.ymin() < b.box.ymin();
+    });
+
+    // Each round unions neighbouring pairs as tasks of the calling arena, an odd mesh out carries over
+    int round = 0;
+    while (operands.size() > 1) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<MergeOperand> merged((operands.size() + 1) / 2);
+        std::atomic<size_t> unions = 0;
+        std::atomic<size_t> concatenations = 0;
+
+        tbb::parallel_for((size_t)0, merged.size(), [&](size_t i) {
+            if (2 * i + 1 >= operands.size()) {
+                merged[i] = std::move(operands[2 * i]);
+                return;
+            }
+
+            MergeOperand& lower = operands[2 * i];
+            MergeOperand& upper = operands[2 * i + 1];
+            merged[i].box = lower.box + upper.box;
+            // The boxes enclose the exact points, apart they cannot intersect and a plain join is the union
+            if (CGAL::do_overlap(lower.box, upper.box)) {
+                merged[i].mesh = MergeTwoMesh(std::move(lower.mesh), std::move(upper.mesh));
+                unions++;
+            } else {
+                lower.mesh.join(upper.mesh);
+                merged[i].mesh = std::move(lower.mesh);
+                concatenations++;
+            }
+        });
+
+        operands = std::move(merged);
+
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        size_t faces = 0, largest = 0;
+        for (const auto &operand : operands) {
+            faces += operand.mesh.number_of_faces();
+            largest = std::max(largest, (size_t)operand.mesh.number_of_faces());
+        }
+        printf("Merge round %d: %zu unions, %zu joins in %.3f seconds, %zu meshes with %zu faces (largest %zu).\n",
+            ++round, unions.load(), concatenations.load(), seconds, operands.size(), faces, largest);
+    }
+
+    return std::move(operands.front().mesh);
+}
+
+// Shell pieces at one layer interface, point indices are local to it
+struct SlabInterface {
+    std::vector<Point_3> points;
+    std::vector<std::array<size_t, 3>> faces;
+    // Points along every boundary edge of the layer below and above, both end points included
+    std::vector<std::vector<size_t>> below_edges;
+    std::vector<std::vector<size_t>> above_edges;
+};
+
+static bool InsideLayer(const CDT& cdt, const std::unordered_map<Face_handle, bool>& in_domain_map, const Point_2& p, Face_handle& hint)
+{
+    if (cdt.dimension() < 2) return false;
+
+    Face_handle f = cdt.locate(p, hint);
+    hint = f;
+    if (cdt.is_infinite(f)) return false;
+
+    auto it = in_domain_map.find(f);
+    return it != in_domain_map.end() && it->second;
+}
+
+static SlabInterface BuildSlabInterface(const std::vector<Polygon_with_holes_2>* below, const std::vector<Polygon_with_holes_2>* above, double height)
+{
+    SlabInterface result;
+
+    // Both outlines go into one triangulation, where they cross their edges get split
+    CDT cdt;
+    std::vector<std::pair<CDT::Vertex_handle, CDT::Vertex_handle>> below_edges;
+    std::vector<std::pair<CDT::Vertex_handle, CDT::Vertex_handle>> above_edges;
+    auto insert_layer = [&cdt](const std::vector<Polygon_with_holes_2>* layer, std::vector<std::pair<CDT::Vertex_handle, CDT::Vertex_handle>>& edges) {
+        if (layer == nullptr) return;
+        auto insert_ring = [&](const Polygon_2& ring) {
+            std::vector<CDT::Vertex_handle> handles;
+            for (const auto &p : ring.vertices()) {
+                handles.push_back(cdt.insert(p));
+            }
+            for (size_t i = 0; i < handles.size(); i++) {
+                CDT::Vertex_handle a = handles[i];
+                CDT::Vertex_handle b = handles[(i + 1) % handles.size()];
+                if (a != b) cdt.insert_constraint(a, b);
+                edges.push_back({a, b});
+            }
+        };
+        for (const auto &pwh : *layer) {
+            insert_ring(pwh.outer_boundary());
+            for (auto h = pwh.holes_begin(); h != pwh.holes_end(); ++h) {
+                insert_ring(*h);
+            }
+        }
+    };
+    insert_layer(below, below_edges);
+    insert_layer(above, above_edges);
+
+    std::unordered_map<CDT::Vertex_handle, size_t> point_index;
+    auto index_of = [&](CDT::Vertex_handle v) {
+        auto it = point_index.find(v);
+        if (it != point_index.end()) return it->second;
+        const Point_2 &p = v->point();
+        result.points.push_back(Point_3(p.x(), height, p.y()));
+        point_index.emplace(v, result.points.size() - 1);
+        return result.points.size() - 1;
+    };
+
+    // Follows the constrained sub edges from one end of an outline edge to the other
+    auto edge_chain = [&](CDT::Vertex_handle from, CDT::Vertex_handle to) {
+        std::vector<size_t> chain;
+        CDT::Vertex_handle v = from;
+        while (v != to) {
+            chain.push_back(index_of(v));
+            CDT::Vertex_handle next;
+            CDT::Edge_circulator ec = cdt.incident_edges(v), done(ec);
+            do {
+                if (!cdt.is_constrained(*ec)) continue;
+                CDT::Vertex_handle w = ec->first->vertex(cdt.cw(ec->second));
+                if (w == v) w = ec->first->vertex(cdt.ccw(ec->second));
+                if (cdt.is_infinite(w)) continue;
+                if (CGAL::collinear(from->point(), to->point(), w->point()) &&
+                    CGAL::collinear_are_ordered_along_line(v->point(), w->point(), to->point())) {
+                    next = w;
+                    break;
+                }
+            } while (++ec != done);
+            if (next == CDT::Vertex_handle()) break;
+            v = next;
+        }
+        chain.push_back(index_of(to));
+        return chain;
+    };
+    for (const auto &edge : below_edges) {
+        result.below_edges.push_back(edge_chain(edge.first, edge.second));
+    }
+    for (const auto &edge : above_edges) {
+        result.above_edges.push_back(edge_chain(edge.first, edge.second));
+    }
+
+    // Inside exactly one of the two layers is a horizontal face of the shell
+    CDT below_cdt, above_cdt;
+    std::unordered_map<Face_handle, bool> below_domain, above_domain;
+    if (below != nullptr) LayerMapper::TriangulateLayer(*below, below_cdt, below_domain);
+    if (above != nullptr) LayerMapper::TriangulateLayer(*above, above_cdt, above_domain);
+
+    Face_handle below_hint, above_hint;
+    for (auto f : cdt.finite_face_handles()) {
+        Point_2 center = CGAL::centroid(f->vertex(0)->point(), f->vertex(1)->point(), f->vertex(2)->point());
+        bool in_below = InsideLayer(below_cdt, below_domain, center, below_hint);
+        bool in_above = InsideLayer(above_cdt, above_domain, center, above_hint);
+        if (in_below == in_above) continue;
+
+        size_t a = index_of(f->vertex(0));
+        size_t b = index_of(f->vertex(1));
+        size_t c = index_of(f->vertex(2));
+        // Height runs along y, a triangle counter-clockwise in the layer plane faces down
+        if (in_above) {
+            result.faces.push_back({a, b, c});
+        } else {
+            result.faces.push_back({a, c, b});
+        }
+    }
+
+    return result;
+}
+
+bool LayerMapper::BuildSlabShell(const std::vector<const std::vector<Polygon_with_holes_2>*>& footprints, const std::vector<double>& interface_heights, Mesh& shell)
+{
+    size_t layer_count = footprints.size();
+    std::vector<SlabInterface> interfaces(layer_count + 1);
+    tbb::parallel_for((size_t)0, interfaces.size(), [&](size_t k) {
+        const std::vector<Polygon_with_holes_2>* below = k > 0 ? footprints[k - 1] : nullptr;
+        const std::vector<Polygon_with_holes_2>* above = k < layer_count ? footprints[k] : nullptr;
+        interfaces[k] = BuildSlabInterface(below, above, interface_heights[k]);
+    });
+
+    std::vector<size_t> offsets(interfaces.size() + 1, 0);
+    for (size_t k = 0; k < interfaces.size(); k++) {
+        offsets[k + 1] = offsets[k] + interfaces[k].points.size();
+    }
+
+    // Each side wall zips an outline edge as split at the layer's bottom interface to the same edge split at its top
+    std::vector<std::vector<std::array<size_t, 3>>> walls(layer_count);
+    tbb::parallel_for((size_t)0, layer_count, [&](size_t k) {
+        const SlabInterface& bottom = interfaces[k];
+        const SlabInterface& top = interfaces[k + 1];
+        size_t edge_count = std::min(bottom.above_edges.size(), top.below_edges.size());
+        for (size_t e = 0; e < edge_count; e++) {
+            const std::vector<size_t>& lower = bottom.above_edges[e];
+            const std::vector<size_t>& upper = top.below_edges[e];
+            auto planar = [](const Point_3& p) { return Point_2(p.x(), p.z()); };
+            Point_2 start = planar(bottom.points[lower[0]]);
+
+            size_t i = 0, j = 0;
+            while (i + 1 < lower.size() || j + 1 < upper.size()) {
+                bool advance_lower = j + 1 >= upper.size() ||
+                    (i + 1 < lower.size() && CGAL::compare_distance_to_point(start,
+                        planar(bottom.points[lower[i + 1]]), planar(top.points[upper[j + 1]])) != CGAL::LARGER);
+
+                // Outline edges keep the footprint on their left, walls face right
+                if (advance_lower) {
+                    walls[k].push_back({offsets[k] + lower[i + 1], offsets[k] + lower[i], offsets[k + 1] + upper[j]});
+                    i++;
+                } else {
+                    walls[k].push_back({offsets[k + 1] + upper[j], offsets[k + 1] + upper[j + 1], offsets[k] + lower[i]});
+                    j++;
+                }
+            }
         }
+    });
 
-        for (auto& f : futures) {
-            meshes.push_back(f.get());
+    std::vector<Point_3> points;
+    std::vector<std::vector<size_t>> polygons;
+    points.reserve(offsets.back());
+    for (size_t k = 0; k < interfaces.size(); k++) {
+        points.insert(points.end(), interfaces[k].points.begin(), interfaces[k].points.end());
+        for (const auto &f : interfaces[k].faces) {
+            polygons.push_back({offsets[k] + f[0], offsets[k] + f[1], offsets[k] + f[2]});
+        }
+    }
+    for (const auto &layer_walls : walls) {
+        for (const auto &f : layer_walls) {
+            polygons.push_back({f[0], f[1], f[2]});
         }
     }
+    interfaces.clear();
+    walls.clear();
 
-    return std::move(meshes.front());
+    // Footprints touching in a point leave non manifold vertices, orienting the soup splits them.
+    // Outlines of neighbouring layers sharing an edge in opposite directions put four faces on
+    // it, the soup is split there too and the shell comes out open
+    bool oriented = CGAL::Polygon_mesh_processing::orient_polygon_soup(points, polygons);
+    shell.clear();
+    CGAL::Polygon_mesh_processing::polygon_soup_to_polygon_mesh(points, polygons, shell);
+
+    if (!oriented || !CGAL::is_closed(shell)) {
+        printf("Slab shell is not closed (%u vertices, %u faces%s).\n", (unsigned)shell.number_of_vertices(),
+            (unsigned)shell.number_of_faces(), oriented ? "" : ", soup had to be split");
+        return false;
+    }
+
+    // The soup is only oriented consistently, each component may still face inwards. Orienting
+    // the shell to bound a volume needs it free of self intersections
+    if (CGAL::Polygon_mesh_processing::does_self_intersect<CGAL::Parallel_if_available_tag>(shell)) {
+        printf("Slab shell intersects itself (%u faces).\n", (unsigned)shell.number_of_faces());
+        return false;
+    }
+    CGAL::Polygon_mesh_processing::orient_to_bound_a_volume(shell);
+
+    printf("Built slab shell with %u vertices and %u faces.\n", (unsigned)shell.number_of_vertices(), (unsigned)shell.number_of_faces());
+    return true;
 }
 
 Mesh LayerMapper::RemeshModel(Mesh model)
@@ -249,70 +774,325 @@ Mesh LayerMapper::NefToMesh(const Nef_polyhedron& nef) {
     return m;
 }
 
-Mesh LayerMapper::MergeLayersToModelWithNef(std::vector<Mesh> layers)
+// Shared by the tasks of one Nef merge
+struct NefReduction {
+    const std::vector<Mesh>* layers;
+    size_t memory_budget;
+    size_t bytes_per_vertex;
+    // Estimated bytes of the Nef polyhedra currently alive
+    std::atomic<size_t> live_bytes = 0;
+    // One step per layer conversion and per union
+    size_t total_steps;
+    std::atomic<size_t> done_steps = 0;
+    std::atomic<int> reported_percent = 0;
+};
+
+static size_t NefBytes(const NefReduction& reduction, const Nef_polyhedron& nef)
 {
-    Nef_polyhedron merge_nef;
-    int completed = 0;
-    int total = layers.size();
-    for (const auto& m : layers) {
-        printf("Merging layer %d/%d into Nef model...\n", ++completed, total);
-        Nef_polyhedron layer_nef = MeshToNef(m);
-
-        if (merge_nef.is_empty()) {
-            merge_nef = layer_nef;
-        } else {
-            merge_nef += layer_nef;
+    return nef.number_of_vertices() * reduction.bytes_per_vertex;
+}
+
+static void ReportNefStep(NefReduction& reduction)
+{
+    size_t done = ++reduction.done_steps;
+    int percent = (int)(100 * done / reduction.total_steps) / 10 * 10;
+    int reported = reduction.reported_percent.load();
+    while (percent > reported) {
+        if (reduction.reported_percent.compare_exchange_weak(reported, percent)) {
+            printf("Nef merge %d%% (%zu/%zu steps, ~%zu MB held).\n",
+                percent, done, reduction.total_steps, reduction.live_bytes.load() >> 20);
+            break;
         }
     }
+}
+
+// Union of layers first..last-1. Both halves are Z neighbours, so every union
+// joins touching solids, and the recursion is depth first so only the
+// subtrees in flight hold intermediate results
+static Nef_polyhedron ReduceNef(NefReduction& reduction, size_t first, size_t last)
+{
+    if (last - first == 1) {
+        Nef_polyhedron nef = LayerMapper::MeshToNef((*reduction.layers)[first]);
+        reduction.live_bytes += NefBytes(reduction, nef);
+        ReportNefStep(reduction);
+        return nef;
+    }
+
+    size_t middle = first + (last - first) / 2;
+    Nef_polyhedron lower, upper;
+    // Running the halves side by side keeps both their results alive, over budget they run one after the other
+    if (reduction.live_bytes.load() < reduction.memory_budget) {
+        tbb::parallel_invoke([&]() { lower = ReduceNef(reduction, first, middle); },
+                             [&]() { upper = ReduceNef(reduction, middle, last); });
+    } else {
+        lower = ReduceNef(reduction, first, middle);
+        upper = ReduceNef(reduction, middle, last);
+    }
+
+    size_t operand_bytes = NefBytes(reduction, lower) + NefBytes(reduction, upper);
+    lower += upper;
+    upper = Nef_polyhedron();
+    reduction.live_bytes += NefBytes(reduction, lower);
+    reduction.live_bytes -= operand_bytes;
+    ReportNefStep(reduction);
+    return lower;
+}
+
+Mesh LayerMapper::MergeLayersToModelWithNef(std::vector<Mesh> layers, size_t memory_budget, size_t bytes_per_vertex)
+{
+    if (layers.empty()) return Mesh();
+
+    NefReduction reduction;
+    reduction.layers = &layers;
+    reduction.memory_budget = memory_budget;
+    reduction.bytes_per_vertex = bytes_per_vertex;
+    reduction.total_steps = 2 * layers.size() - 1;
+
+    Nef_polyhedron merge_nef = ReduceNef(reduction, 0, layers.size());
+    layers.clear();
+
     merge_nef.regularization(); 
     Mesh final_result = NefToMesh(merge_nef);
     return final_result;
 }
 
-Mesh LayerMapper::GenerateMesh(std::vector<GCodeLayer> layers)
+// FNV-1a over the grid coordinates
+static uint64_t HashKeyCoords(const std::vector<int32_t>& coords)
 {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int32_t c : coords) {
+        hash ^= (uint32_t)c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
 
-    time_t start_time = time(nullptr);
-    std::vector<Mesh> layer_meshes(layers.size());
+LayerKey LayerMapper::QuantizeLayer(const std::vector<LayerPolyline>& lines, float layer_height)
+{
+    LayerKey key;
+    key.coords.push_back((int32_t)std::lround(layer_height * UNION_GRID_SCALE));
+    for (const auto &line : lines) {
+        // Point count first, so the same points split into other polylines differ
+        key.coords.push_back((int32_t)line.size());
+        for (const auto &p : line) {
+            key.coords.push_back((int32_t)std::lround(p.x * UNION_GRID_SCALE));
+            key.coords.push_back((int32_t)std::lround(p.y * UNION_GRID_SCALE));
+        }
+    }
 
-    std::for_each(std::execution::par, layers.begin(), layers.end(),
-        [&](const GCodeLayer& layer) {
-            std::vector<Polygon_with_holes_2> layer_polygons =
-                GCodePathsToPolygons(layer.points, layer.paths);
+    key.hash = HashKeyCoords(key.coords);
+    return key;
+}
 
-            Mesh layer_mesh = PolygonsLayerToMesh(layer_polygons, layer.layerHeight);
-            LayerMapper::ShiftLayerMesh(layer_mesh, layer.layer, layer.layerHeight);
+LayerKey LayerMapper::QuantizeFootprint(const std::vector<Polygon_with_holes_2>& polygons)
+{
+    // Rings start at their lowest snapped vertex and are sorted, so the key does not
+    // depend on where the union happened to start a ring or the order it emitted them
+    auto ring_coords = [](const Polygon_2& ring) {
+        std::vector<int32_t> coords;
+        coords.reserve(ring.size() * 2 + 1);
+        coords.push_back((int32_t)ring.size());
+        for (const auto &p : ring.vertices()) {
+            coords.push_back((int32_t)std::lround(CGAL::to_double(p.x()) * UNION_GRID_SCALE));
+            coords.push_back((int32_t)std::lround(CGAL::to_double(p.y()) * UNION_GRID_SCALE));
+        }
+        size_t lowest = 1;
+        for (size_t i = 3; i < coords.size(); i += 2) {
+            if (std::make_pair(coords[i], coords[i + 1]) < std::make_pair(coords[lowest], coords[lowest + 1])) lowest = i;
+        }
+        std::rotate(coords.begin() + 1, coords.begin() + lowest, coords.end());
+        return coords;
+    };
 
-            size_t index = &layer - &layers[0];
-            layer_meshes[index] = std::move(layer_mesh);
+    std::vector<std::vector<int32_t>> polygon_coords;
+    for (const auto &pwh : polygons) {
+        std::vector<int32_t> coords = ring_coords(pwh.outer_boundary());
+        std::vector<std::vector<int32_t>> holes;
+        for (auto h = pwh.holes_begin(); h != pwh.holes_end(); ++h) {
+            holes.push_back(ring_coords(*h));
         }
-    );
+        std::sort(holes.begin(), holes.end());
+        coords.push_back((int32_t)holes.size());
+        for (const auto &hole : holes) {
+            coords.insert(coords.end(), hole.begin(), hole.end());
+        }
+        polygon_coords.push_back(std::move(coords));
+    }
+    std::sort(polygon_coords.begin(), polygon_coords.end());
 
-    time_t end_time = time(nullptr);
-    double elapsed = difftime(end_time, start_time);
-    printf("Layer generation and extrusion completed in %.2f seconds.\n", elapsed);
+    LayerKey key;
+    for (const auto &coords : polygon_coords) {
+        key.coords.insert(key.coords.end(), coords.begin(), coords.end());
+    }
+    key.hash = HashKeyCoords(key.coords);
+    return key;
+}
 
+Mesh LayerMapper::GenerateMesh(const std::vector<GCodeLayer>& layers, const std::vector<GCodePoint>& points, const std::vector<GCodePath>& paths)
+{
+    ModelGenTasks::SetConcurrency(max_threads);
 
-    start_time = time(nullptr);
-    Mesh final_model;
-    if(Nef_based) {
-        final_model = MergeLayersToModelWithNef(layer_meshes);
-    }else{
-        final_model = MergeLayersToModel(layer_meshes);
-    }
-    end_time = time(nullptr);
-    elapsed = difftime(end_time, start_time);
-    printf("Model merging completed in %.2f seconds.\n", elapsed);
+    // Every stage below, and the tile and merge loops they nest, runs in this one arena
+    return ModelGenTasks::Run(ModelGenTasks::BATCH, [&]() -> Mesh {
+        time_t start_time = time(nullptr);
 
-    if(remesh_after_layers){
-        start_time = time(nullptr);
-        final_model = RemeshModel(final_model);
-        end_time = time(nullptr);
-        elapsed = difftime(end_time, start_time);
-        printf("Remeshing final model completed in %.2f seconds.\n", elapsed);
-    }
+        std::vector<std::vector<LayerPolyline>> layer_lines(layers.size());
+        std::vector<LayerKey> layer_keys(layers.size());
+        tbb::parallel_for((size_t)0, layers.size(), [&](size_t index) {
+            layer_lines[index] = BuildLayerLines(points, paths, layers[index].paths);
+            if (dedup_layers) {
+                layer_keys[index] = QuantizeLayer(layer_lines[index], layers[index].layerHeight);
+            }
+        });
+
+        // Layers with the same quantized toolpaths and height share one extruded slab
+        std::vector<size_t> source(layers.size());
+        std::unordered_map<uint64_t, std::vector<size_t>> by_hash;
+        size_t dedup_hits = 0;
+        for (size_t index = 0; index < layers.size(); index++) {
+            source[index] = index;
+            if (dedup_layers) {
+                std::vector<size_t>& candidates = by_hash[layer_keys[index].hash];
+                for (size_t candidate : candidates) {
+                    if (layer_keys[candidate].coords == layer_keys[index].coords) {
+                        source[index] = candidate;
+                        break;
+                    }
+                }
+                if (source[index] == index) candidates.push_back(index);
+                else dedup_hits++;
+            }
+        }
+        layer_keys.clear();
+
+        std::vector<size_t> unique_layers;
+        for (size_t index = 0; index < layers.size(); index++) {
+            if (source[index] == index) unique_layers.push_back(index);
+        }
+
+        std::vector<std::vector<Polygon_with_holes_2>> unique_polygons(layers.size());
+        std::vector<LayerKey> footprint_keys(layers.size());
+        tbb::parallel_for((size_t)0, unique_layers.size(), [&](size_t u) {
+            size_t index = unique_layers[u];
+            unique_polygons[index] = LinesToPolygons(layer_lines[index]);
+            if (merge_layer_runs) {
+                footprint_keys[index] = QuantizeFootprint(unique_polygons[index]);
+            }
+        });
+        layer_lines.clear();
+
+        // A layer continues the run below it when its unioned footprint is the same,
+        // whatever toolpaths (infill direction) made it. Layers always reach down to
+        // the one below (layerHeight is the gap to it), so there is no gap to check
+        std::vector<LayerRun> runs;
+        for (size_t index = 0; index < layers.size(); index++) {
+            if (merge_layer_runs && !runs.empty()) {
+                const LayerKey& below_key = footprint_keys[source[index - 1]];
+                const LayerKey& key = footprint_keys[source[index]];
+                if (below_key.hash == key.hash && below_key.coords == key.coords) {
+                    runs.back().last = index;
+                    continue;
+                }
+            }
+            runs.push_back({index, index});
+        }
+        footprint_keys.clear();
+
+        if (dedup_layers && !layers.empty()) {
+            printf("Layer dedup: %zu of %zu layers reused an identical layer (%.1f%% hit rate).\n",
+                dedup_hits, layers.size(), 100.0 * dedup_hits / layers.size());
+        }
+        if (merge_layer_runs && !layers.empty()) {
+            printf("Layer runs: %zu layers stacked into %zu runs.\n", layers.size(), runs.size());
+        }
+
+        Mesh final_model;
+        bool shell_built = false;
+        if (slab_shell && !layers.empty()) {
+            time_t end_time = time(nullptr);
+            double elapsed = difftime(end_time, start_time);
+            printf("Layer footprint generation completed in %.2f seconds.\n", elapsed);
+
+            // layerHeight is the gap to the layer below, the first layer reaches down to the bed
+            std::vector<const std::vector<Polygon_with_holes_2>*> footprints(runs.size());
+            std::vector<double> interface_heights(runs.size() + 1);
+            interface_heights[0] = layers[0].layer - layers[0].layerHeight;
+            for (size_t r = 0; r < runs.size(); r++) {
+                footprints[r] = &unique_polygons[source[runs[r].first]];
+                interface_heights[r + 1] = layers[runs[r].last].layer;
+            }
 
-    return final_model;
+            start_time = time(nullptr);
+            shell_built = BuildSlabShell(footprints, interface_heights, final_model);
+            if (!shell_built) {
+                printf("Falling back to extruding and merging the layers.\n");
+                start_time = time(nullptr);
+            }
+        }
+        if (!shell_built) {
+            // Single layer runs reuse one slab per group, taller runs get their own prism
+            std::vector<size_t> slab_layers;
+            std::vector<bool> has_slab(layers.size(), false);
+            for (const auto &run : runs) {
+                size_t index = source[run.first];
+                if (run.first == run.last && !has_slab[index]) {
+                    has_slab[index] = true;
+                    slab_layers.push_back(index);
+                }
+            }
+            std::vector<Mesh> unique_meshes(layers.size());
+            tbb::parallel_for((size_t)0, slab_layers.size(), [&](size_t u) {
+                size_t index = slab_layers[u];
+                unique_meshes[index] = PolygonsLayerToMesh(unique_polygons[index], layers[index].layerHeight);
+            });
+
+            std::vector<Mesh> layer_meshes(runs.size());
+            tbb::parallel_for((size_t)0, runs.size(), [&](size_t r) {
+                const LayerRun& run = runs[r];
+                const GCodeLayer& top = layers[run.last];
+                float height = top.layer - (layers[run.first].layer - layers[run.first].layerHeight);
+                Mesh layer_mesh = run.first == run.last ? unique_meshes[source[run.first]]
+                                                        : PolygonsLayerToMesh(unique_polygons[source[run.first]], height);
+                LayerMapper::ShiftLayerMesh(layer_mesh, top.layer, height);
+                layer_meshes[r] = std::move(layer_mesh);
+            });
+            unique_meshes.clear();
+
+            time_t end_time = time(nullptr);
+            double elapsed = difftime(end_time, start_time);
+            printf("Layer generation and extrusion completed in %.2f seconds.\n", elapsed);
+
+            start_time = time(nullptr);
+            if(Nef_based) {
+                final_model = MergeLayersToModelWithNef(layer_meshes, (size_t)nef_memory_budget_mb << 20, (size_t)nef_bytes_per_vertex);
+            }else{
+                final_model = MergeLayersToModel(layer_meshes);
+            }
+        }
+        time_t end_time = time(nullptr);
+        double elapsed = difftime(end_time, start_time);
+        printf("Model merging completed in %.2f seconds.\n", elapsed);
+
+        if(remesh_after_layers){
+            start_time = time(nullptr);
+            final_model = RemeshModel(final_model);
+            end_time = time(nullptr);
+            elapsed = difftime(end_time, start_time);
+            printf("Remeshing final model completed in %.2f seconds.\n", elapsed);
+        }
+
+        return final_model;
+    });
+}
+
+Mesh LayerMapper::GenerateLayerMesh(const GCodeLayer& layer, const std::vector<GCodePoint>& points, const std::vector<GCodePath>& paths)
+{
+    return ModelGenTasks::Run(ModelGenTasks::INTERACTIVE, [&]() -> Mesh {
+        std::vector<Polygon_with_holes_2> polygons = LinesToPolygons(BuildLayerLines(points, paths, layer.paths));
+        Mesh layer_mesh = PolygonsLayerToMesh(polygons, layer.layerHeight);
+        ShiftLayerMesh(layer_mesh, layer.layer, layer.layerHeight);
+        return layer_mesh;
+    });
 }
 
 void LayerMapper::ShiftLayerMesh(Mesh& extruded_layer, float layer_offset, float layer_height) {
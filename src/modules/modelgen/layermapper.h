@@ -1,25 +1,48 @@
 #pragma once
 
 #define LAYER_OVERLAP 0.01f
+// Nozzle disks closer than this (mm) are placed once
+#define NOZZLE_MERGE_TOLERANCE 1e-4
+// Layers with at least this many footprints are unioned in spatial tiles
+#define UNION_TILE_MIN_FOOTPRINTS 20000
+// Footprints per tile the tile grid is sized for
+#define UNION_TILE_FOOTPRINTS 4096
 
-#include <deque>
-#include <future>
-
-#include <execution>
 #include <algorithm>
 #include <numeric>
 #include <vector>
 #include <mutex>
+#include <atomic>
+#include <cmath>
+#include <span>
+#include <array>
 
 #include <unordered_set>
+#include <unordered_map>
 
 #include "layermappertypes.h"
+#include "pathsimplifier.h"
+#include "polygonunion.h"
+#include "modelgentasks.h"
 
 struct Nozzle2D {
     Polygon_2 polygon;
     float diameter;
 };
 
+// Layer toolpaths and height, or a layer footprint, snapped to the union grid.
+// Equal keys extrude to the same slab
+struct LayerKey {
+    std::vector<int32_t> coords;
+    uint64_t hash = 0;
+};
+
+// Consecutive layers first..last with the same outline, built as one prism
+struct LayerRun {
+    size_t first;
+    size_t last;
+};
+
 struct GCodePoint;
 struct GCodePath;
 struct GCodeLayer;
@@ -35,30 +58,85 @@ public:
         HIGH = 2
     }; 
     NozzleQuality nozzleQuality = MEDIUM;
+    // Layer union, UNION_FAST falls back to UNION_EXACT on layers it cannot resolve
+    enum UnionBackend
+    {
+        UNION_EXACT = 0,
+        UNION_FAST = 1
+    };
+    UnionBackend unionBackend = UNION_FAST;
+    // Split large layers into tiles, unioned in parallel and merged pairwise
+    bool tile_large_layers = true;
+    // One outline per continuous extrusion instead of per segment and vertex, fast backend only
+    bool bead_footprints = true;
     Nozzle2D nozzle;
     bool Nef_based = false;
+    // Estimated Nef memory (MB) above which the Nef merge stops running subtrees in parallel
+    int nef_memory_budget_mb = 4096;
+    // Heap bytes assumed per Nef vertex for that estimate. Each vertex carries
+    // its sphere map and exact coordinates, a few KB; to calibrate, compare
+    // the "MB held" of the merge log with the process resident size
+    int nef_bytes_per_vertex = 4096;
+    // Modelgen threads, 0 uses every core
+    int max_threads = 0;
     bool remesh_after_layers = false;
     float remesh_target_length = 1.1f;
     float remesh_edge_angle = 45.0f;
     int remesh_iterations = 1;
 
+    // Extrude layers with identical toolpaths once and reuse the slab
+    bool dedup_layers = true;
+    // Build runs of consecutive layers with the same outline as one tall prism
+    bool merge_layer_runs = true;
+
+    // Path simplification before polygonization, tolerance is a fraction of the nozzle diameter
+    bool simplify_paths = true;
+    float simplify_tolerance = 0.05f;
+
     // Merge
+    // Build the shell straight from the layer footprints, walls plus the
+    // difference between neighbouring layers, instead of 3D unions of slabs
+    bool slab_shell = true;
+
     static Mesh MergeLayersToModel(std::vector<Mesh> layers);
     static Nef_polyhedron MeshToNef(const Mesh& m);
     static Mesh NefToMesh(const Nef_polyhedron& nef);
-    static Mesh MergeLayersToModelWithNef(std::vector<Mesh> layers);
+    static Mesh MergeLayersToModelWithNef(std::vector<Mesh> layers, size_t memory_budget = (size_t)4096 << 20, size_t bytes_per_vertex = 4096);
     static Mesh MergeTwoMesh(Mesh m1, Mesh m2);
     static void ShiftLayerMesh(Mesh& extruded_layer, float layer_offset, float layer_height);
+    // interface_heights holds the bottom of the first layer and the top of every layer.
+    // False when the shell does not come out closed or intersects itself, shell is unusable then.
+    // A usable shell is oriented outwards
+    static bool BuildSlabShell(const std::vector<const std::vector<Polygon_with_holes_2>*>& footprints, const std::vector<double>& interface_heights, Mesh& shell);
 
     LayerMapper();
 
     void Set2DNozzlePolygon(float diameter);
     Polygon_2 place_nozzle_at(Polygon_2 nozzle, Point_2 vertex);
 
-    std::vector<Polygon_with_holes_2> GCodePathsToPolygons(std::vector<GCodePoint> points, std::vector<GCodePath> paths);
+    // layerPaths indexes into paths, whose start and end index into points (1-based)
+    std::vector<Polygon_with_holes_2> GCodePathsToPolygons(const std::vector<GCodePoint>& points, const std::vector<GCodePath>& paths, std::span<const uint32_t> layerPaths);
+    // Polylines of a layer, simplified when enabled
+    std::vector<LayerPolyline> BuildLayerLines(const std::vector<GCodePoint>& points, const std::vector<GCodePath>& paths, std::span<const uint32_t> layerPaths);
+    std::vector<Polygon_with_holes_2> LinesToPolygons(const std::vector<LayerPolyline>& lines);
+    static LayerKey QuantizeLayer(const std::vector<LayerPolyline>& lines, float layer_height);
+    // Unioned footprint on the union grid, equal keys are the same outline
+    static LayerKey QuantizeFootprint(const std::vector<Polygon_with_holes_2>& polygons);
+    // Footprint rings of a layer, a rectangle per segment and a nozzle disk per
+    // vertex, or one round capped outline per polyline (overlaps itself, fast union only)
+    std::vector<UnionRing> SegmentFootprints(const std::vector<LayerPolyline>& lines);
+    std::vector<UnionRing> BeadFootprints(const std::vector<LayerPolyline>& lines);
+    // Union of footprint rings, false when the fast backend cannot resolve the layer
+    bool UnionFootprints(const std::vector<UnionRing>& footprints, UnionBackend backend, std::vector<Polygon_with_holes_2>& final_output);
+    bool UnionFootprintsTiled(const std::vector<UnionRing>& footprints, UnionBackend backend, std::vector<Polygon_with_holes_2>& final_output);
+    static std::vector<Polygon_with_holes_2> ExactUnion(const std::vector<UnionRing>& footprints);
+    // Constrained triangulation of a footprint, in_domain_map marks the faces inside it
+    static void TriangulateLayer(const std::vector<Polygon_with_holes_2>& layer, CDT& cdt, std::unordered_map<Face_handle, bool>& in_domain_map);
     Mesh PolygonsLayerToMesh(std::vector<Polygon_with_holes_2>& layer, float layer_height);
 
     Mesh RemeshModel(Mesh model);
 
-    Mesh GenerateMesh(std::vector<GCodeLayer> layers);
+    Mesh GenerateMesh(const std::vector<GCodeLayer>& layers, const std::vector<GCodePoint>& points, const std::vector<GCodePath>& paths);
+    // Slab of one layer for previews, runs ahead of a full model generation in progress
+    Mesh GenerateLayerMesh(const GCodeLayer& layer, const std::vector<GCodePoint>& points, const std::vector<GCodePath>& paths);
 };
@@ -8,6 +8,7 @@
 #include <CGAL/create_offset_polygons_2.h>
 #include <CGAL/Polygon_mesh_processing/extrude.h>
 #include <CGAL/Polygon_mesh_processing/corefinement.h>
+#include <CGAL/Polygon_mesh_processing/bbox.h>
 #include <CGAL/Boolean_set_operations_2.h>
 
 #include <CGAL/Surface_mesh.h>
@@ -27,6 +28,10 @@
 #include <CGAL/Polygon_mesh_processing/merge_border_vertices.h>
 #include <CGAL/Polygon_mesh_processing/stitch_borders.h>
 #include <CGAL/Polygon_mesh_processing/repair.h>
+#include <CGAL/Polygon_mesh_processing/orient_polygon_soup.h>
+#include <CGAL/Polygon_mesh_processing/polygon_soup_to_polygon_mesh.h>
+#include <CGAL/Polygon_mesh_processing/orientation.h>
+#include <CGAL/Polygon_mesh_processing/self_intersections.h>
 
 //#include <CGAL/property_map.h>
 #include <boost/property_map/property_map.hpp>
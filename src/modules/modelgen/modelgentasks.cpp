@@ -0,0 +1,47 @@
+#include "modelgentasks.h"
+
+#include <algorithm>
+#include <mutex>
+
+static std::mutex arenaMutex;
+static int arenaConcurrency = 0;
+static std::shared_ptr<tbb::task_arena> arenas[2];
+
+void ModelGenTasks::SetConcurrency(int max_concurrency)
+{
+    std::lock_guard<std::mutex> lock(arenaMutex);
+    if (max_concurrency < 0) {
+        max_concurrency = 0;
+    }
+    if (max_concurrency == arenaConcurrency) {
+        return;
+    }
+    arenaConcurrency = max_concurrency;
+
+    // Jobs still running hold their arena, the next Run creates one with the new limit
+    arenas[BATCH].reset();
+    arenas[INTERACTIVE].reset();
+}
+
+int ModelGenTasks::GetConcurrency()
+{
+    std::lock_guard<std::mutex> lock(arenaMutex);
+    return arenaConcurrency;
+}
+
+std::shared_ptr<tbb::task_arena> ModelGenTasks::Arena(Priority priority)
+{
+    std::lock_guard<std::mutex> lock(arenaMutex);
+    std::shared_ptr<tbb::task_arena>& arena = arenas[priority];
+    if (!arena) {
+        // Every arena needs one thread, a limit of 1 still lets both jobs run
+        int limit = tbb::task_arena::automatic;
+        if (arenaConcurrency > 0) {
+            int interactive = arenaConcurrency / 2;
+            limit = std::max(priority == INTERACTIVE ? interactive : arenaConcurrency - interactive, 1);
+        }
+        tbb::task_arena::priority level = priority == INTERACTIVE ? tbb::task_arena::priority::high : tbb::task_arena::priority::low;
+        arena = std::make_shared<tbb::task_arena>(limit, 1, level);
+    }
+    return arena;
+}
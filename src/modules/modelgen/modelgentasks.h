@@ -0,0 +1,35 @@
+#pragma once
+#include <memory>
+#include <utility>
+
+#include <tbb/task_arena.h>
+
+// Task arenas every parallel modelgen stage runs in. With a concurrency
+// limit the two arenas split it between them, batch taking the larger
+// half, so a batch and an interactive job running together never use more
+// threads than that. Nested parallel loops inside a stage stay in the
+// calling arena and are balanced by work stealing instead of starting
+// threads. Without a limit workers serve the interactive arena first, so a
+// short job started while a batch generation runs is not queued behind it.
+class ModelGenTasks{
+public:
+    enum Priority
+    {
+        BATCH = 0,
+        INTERACTIVE = 1
+    };
+
+    // 0 uses every core. Only modelgen arenas are capped, other TBB work
+    // in the process is not
+    static void SetConcurrency(int max_concurrency);
+    static int GetConcurrency();
+
+    template <typename Function>
+    static auto Run(Priority priority, Function&& body) {
+        std::shared_ptr<tbb::task_arena> arena = Arena(priority);
+        return arena->execute(std::forward<Function>(body));
+    }
+
+private:
+    static std::shared_ptr<tbb::task_arena> Arena(Priority priority);
+};
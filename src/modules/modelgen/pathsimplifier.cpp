@@ -0,0 +1,111 @@
+#include "pathsimplifier.h"
+
+#include "../gcode/gcode.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Relative cross product below which three points count as collinear
+#define COLLINEAR_EPSILON 1e-6f
+
+std::vector<LayerPolyline> PathSimplifier::BuildPolylines(const std::vector<GCodePoint>& points, const std::vector<GCodePath>& paths, std::span<const uint32_t> layerPaths)
+{
+    std::vector<LayerPolyline> lines;
+    uint32_t lastEnd = 0;
+    for (uint32_t path_index : layerPaths) {
+        const GCodePath& path = paths[path_index];
+
+        // The interpreter reuses the previous end point when a move continues from it
+        if (lines.empty() || path.start != lastEnd) {
+            const GCodePoint& start = points[path.start - 1];
+            lines.push_back({{start.x, start.z}});
+        }
+        const GCodePoint& end = points[path.end - 1];
+        lines.back().push_back({end.x, end.z});
+        lastEnd = path.end;
+    }
+    return lines;
+}
+
+void PathSimplifier::MergeCollinear(LayerPolyline& line)
+{
+    if (line.size() < 3) {
+        return;
+    }
+
+    // Keep a point only if the line turns there, a reversal is a turn too
+    size_t kept = 1;
+    for (size_t i = 1; i + 1 < line.size(); i++) {
+        const LayerPoint& a = line[kept - 1];
+        const LayerPoint& b = line[i];
+        const LayerPoint& c = line[i + 1];
+        float abx = b.x - a.x, aby = b.y - a.y;
+        float bcx = c.x - b.x, bcy = c.y - b.y;
+        float cross = abx * bcy - aby * bcx;
+        float dot = abx * bcx + aby * bcy;
+        float scale = std::hypot(abx, aby) * std::hypot(bcx, bcy);
+        if (std::fabs(cross) > COLLINEAR_EPSILON * scale || dot < 0.0f) {
+            line[kept++] = b;
+        }
+    }
+    line[kept++] = line.back();
+    line.resize(kept);
+}
+
+void PathSimplifier::DouglasPeucker(LayerPolyline& line, float tolerance)
+{
+    if (line.size() < 3) {
+        return;
+    }
+
+    // Distance of p from segment ab, closed loops have a == b
+    auto distance = [](const LayerPoint& p, const LayerPoint& a, const LayerPoint& b) {
+        float abx = b.x - a.x, aby = b.y - a.y;
+        float apx = p.x - a.x, apy = p.y - a.y;
+        float length2 = abx * abx + aby * aby;
+        float t = length2 > 0.0f ? std::clamp((apx * abx + apy * aby) / length2, 0.0f, 1.0f) : 0.0f;
+        return std::hypot(apx - t * abx, apy - t * aby);
+    };
+
+    std::vector<bool> keep(line.size(), false);
+    keep.front() = true;
+    keep.back() = true;
+
+    std::vector<std::pair<size_t, size_t>> stack = {{0, line.size() - 1}};
+    while (!stack.empty()) {
+        auto [first, last] = stack.back();
+        stack.pop_back();
+
+        float worst = 0.0f;
+        size_t worstIndex = first;
+        for (size_t i = first + 1; i < last; i++) {
+            float d = distance(line[i], line[first], line[last]);
+            if (d > worst) {
+                worst = d;
+                worstIndex = i;
+            }
+        }
+
+        if (worst > tolerance) {
+            keep[worstIndex] = true;
+            stack.push_back({first, worstIndex});
+            stack.push_back({worstIndex, last});
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < line.size(); i++) {
+        if (keep[i]) {
+            line[kept++] = line[i];
+        }
+    }
+    line.resize(kept);
+}
+
+size_t PathSimplifier::Simplify(LayerPolyline& line, float tolerance)
+{
+    size_t before = line.size();
+    MergeCollinear(line);
+    DouglasPeucker(line, tolerance);
+    return before - line.size();
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct GCodePoint;
+struct GCodePath;
+
+// Point in the layer plane, G-code X and Y (stored on x and z)
+struct LayerPoint{
+    float x;
+    float y;
+};
+
+// Consecutive extrusion segments of one layer joined end to start
+using LayerPolyline = std::vector<LayerPoint>;
+
+// Reduces the segments handed to polygonization. Paths are chained into
+// polylines, runs of collinear points are merged and Douglas-Peucker drops
+// every point the line passes within tolerance of.
+class PathSimplifier{
+public:
+    // layerPaths indexes into paths, whose start and end index into points (1-based)
+    static std::vector<LayerPolyline> BuildPolylines(const std::vector<GCodePoint>& points, const std::vector<GCodePath>& paths, std::span<const uint32_t> layerPaths);
+
+    static void MergeCollinear(LayerPolyline& line);
+    static void DouglasPeucker(LayerPolyline& line, float tolerance);
+
+    // Both passes, returns the number of points removed
+    static size_t Simplify(LayerPolyline& line, float tolerance);
+};
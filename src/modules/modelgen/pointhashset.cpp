@@ -0,0 +1,68 @@
+#include "pointhashset.h"
+
+#include <cmath>
+
+#define NO_POINT UINT32_MAX
+
+PointHashSet::PointHashSet(double tolerance) : tolerance(tolerance), inverseCell(1.0 / tolerance)
+{
+}
+
+void PointHashSet::Reserve(size_t count)
+{
+    cells.reserve(count);
+    xs.reserve(count);
+    ys.reserve(count);
+    next.reserve(count);
+}
+
+void PointHashSet::Clear()
+{
+    cells.clear();
+    xs.clear();
+    ys.clear();
+    next.clear();
+}
+
+bool PointHashSet::FindNear(double x, double y, int64_t cx, int64_t cy) const
+{
+    double tolerance2 = tolerance * tolerance;
+    for (int64_t dx = -1; dx <= 1; dx++) {
+        for (int64_t dy = -1; dy <= 1; dy++) {
+            auto it = cells.find(CellKey(cx + dx, cy + dy));
+            if (it == cells.end()) {
+                continue;
+            }
+            for (uint32_t i = it->second; i != NO_POINT; i = next[i]) {
+                double ex = xs[i] - x, ey = ys[i] - y;
+                if (ex * ex + ey * ey <= tolerance2) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool PointHashSet::Contains(double x, double y) const
+{
+    return FindNear(x, y, (int64_t)std::floor(x * inverseCell), (int64_t)std::floor(y * inverseCell));
+}
+
+bool PointHashSet::Insert(double x, double y)
+{
+    int64_t cx = (int64_t)std::floor(x * inverseCell);
+    int64_t cy = (int64_t)std::floor(y * inverseCell);
+    if (FindNear(x, y, cx, cy)) {
+        return false;
+    }
+
+    uint32_t index = (uint32_t)xs.size();
+    xs.push_back(x);
+    ys.push_back(y);
+
+    auto [it, inserted] = cells.try_emplace(CellKey(cx, cy), index);
+    next.push_back(inserted ? NO_POINT : it->second);
+    it->second = index;
+    return true;
+}
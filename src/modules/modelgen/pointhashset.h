@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Set of 2D points that treats points closer than the tolerance as equal.
+// Points are bucketed on an integer grid with cells the size of the
+// tolerance, a lookup checks the 3x3 cells around the query so points on
+// either side of a cell border still merge.
+class PointHashSet{
+public:
+    explicit PointHashSet(double tolerance);
+
+    // Adds the point unless one within tolerance is stored, true if it was added
+    bool Insert(double x, double y);
+    bool Contains(double x, double y) const;
+
+    size_t Size() const { return xs.size(); }
+    void Reserve(size_t count);
+    void Clear();
+
+private:
+    struct CellHash{
+        size_t operator()(uint64_t key) const {
+            // splitmix64 finalizer, neighbouring cells land in distant buckets
+            key ^= key >> 30;
+            key *= 0xbf58476d1ce4e5b9ULL;
+            key ^= key >> 27;
+            key *= 0x94d049bb133111ebULL;
+            key ^= key >> 31;
+            return (size_t)key;
+        }
+    };
+
+    double tolerance;
+    double inverseCell;
+
+    // First point of each cell, the rest of the cell is chained through next
+    std::unordered_map<uint64_t, uint32_t, CellHash> cells;
+    std::vector<double> xs;
+    std::vector<double> ys;
+    std::vector<uint32_t> next;
+
+    static uint64_t CellKey(int64_t cx, int64_t cy) {
+        return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+    }
+    bool FindNear(double x, double y, int64_t cx, int64_t cy) const;
+};
@@ -0,0 +1,634 @@
+#include "polygonunion.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Distance (grid units) below which a vertex counts as lying on its neighbours' line
+#define UNION_COLLINEAR_EPSILON 1e-3
+// Rings with a smaller area (square grid units) are slivers and dropped
+#define UNION_MIN_AREA 1e-6
+
+static double RingArea(const UnionRing& ring)
+{
+    double area = 0.0;
+    for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+        area += ring[j].x * ring[i].y - ring[i].x * ring[j].y;
+    }
+    return area * 0.5;
+}
+
+static bool SamePoint(const UnionPoint& a, const UnionPoint& b)
+{
+    return a.x == b.x && a.y == b.y;
+}
+
+static bool IsCollinear(const UnionPoint& a, const UnionPoint& b, const UnionPoint& c)
+{
+    double acx = c.x - a.x, acy = c.y - a.y;
+    double cross = (b.x - a.x) * acy - (b.y - a.y) * acx;
+    return cross * cross <= UNION_COLLINEAR_EPSILON * UNION_COLLINEAR_EPSILON * (acx * acx + acy * acy);
+}
+
+// Drops vertices on a straight run and zero width spikes, the sweep leaves
+// one wherever an edge stops bounding the union and the next one continues
+static void RemoveCollinear(UnionRing& ring)
+{
+    UnionRing out;
+    out.reserve(ring.size());
+    for (const UnionPoint& p : ring) {
+        while (out.size() >= 2 && IsCollinear(out[out.size() - 2], out.back(), p)) {
+            out.pop_back();
+        }
+        if (out.empty() || !SamePoint(out.back(), p)) {
+            out.push_back(p);
+        }
+    }
+
+    // The first vertices only had successors checked, close the ring over them
+    size_t first = 0;
+    bool changed = true;
+    while (changed && out.size() - first >= 3) {
+        changed = false;
+        if (IsCollinear(out[out.size() - 2], out.back(), out[first]) || SamePoint(out.back(), out[first])) {
+            out.pop_back();
+            changed = true;
+        } else if (IsCollinear(out.back(), out[first], out[first + 1])) {
+            first++;
+            changed = true;
+        }
+    }
+    ring.assign(out.begin() + first, out.end());
+}
+
+static bool ContainsPoint(const UnionRing& ring, const UnionPoint& p)
+{
+    bool inside = false;
+    for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+        const UnionPoint& a = ring[i];
+        const UnionPoint& b = ring[j];
+        if ((a.y > p.y) != (b.y > p.y)) {
+            double x = a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y);
+            if (p.x < x) {
+                inside = !inside;
+            }
+        }
+    }
+    return inside;
+}
+
+double PolygonUnion::XAt(const Edge& e, double y)
+{
+    if (y == e.y0) {
+        return e.x0;
+    }
+    if (y == e.y1) {
+        return e.x1;
+    }
+    // One rounding of an exact numerator on grid scanlines, edges meeting there agree bit for bit
+    return (e.x0 * (e.y1 - y) + e.x1 * (y - e.y0)) / (e.y1 - e.y0);
+}
+
+bool PolygonUnion::AddRing(Sweep& sweep, const UnionRing& ring, bool clockwise)
+{
+    UnionRing snapped;
+    snapped.reserve(ring.size());
+    for (const UnionPoint& p : ring) {
+        UnionPoint s = {std::nearbyint(p.x * UNION_GRID_SCALE), std::nearbyint(p.y * UNION_GRID_SCALE)};
+        if (!(std::fabs(s.x) <= UNION_MAX_COORD && std::fabs(s.y) <= UNION_MAX_COORD)) {
+            return false;
+        }
+        if (snapped.empty() || !SamePoint(snapped.back(), s)) {
+            snapped.push_back(s);
+        }
+    }
+    while (snapped.size() > 1 && SamePoint(snapped.back(), snapped.front())) {
+        snapped.pop_back();
+    }
+    if (snapped.size() < 3) {
+        return true;
+    }
+
+    // Outlines counter-clockwise and holes clockwise, so overlaps add up instead of cancelling
+    double area = RingArea(snapped);
+    if (area == 0.0) {
+        return true;
+    }
+    if ((area < 0.0) != clockwise) {
+        std::reverse(snapped.begin(), snapped.end());
+    }
+
+    for (size_t i = 0; i < snapped.size(); i++) {
+        const UnionPoint& a = snapped[i];
+        const UnionPoint& b = snapped[(i + 1) % snapped.size()];
+        // Horizontal edges bound no scanbeam, the sweep rebuilds them from coverage changes
+        if (a.y == b.y) {
+            continue;
+        }
+
+        Edge e = {};
+        if (a.y < b.y) {
+            e.x0 = a.x; e.y0 = a.y; e.x1 = b.x; e.y1 = b.y;
+            e.wind = -1;
+        } else {
+            e.x0 = b.x; e.y0 = b.y; e.x1 = a.x; e.y1 = a.y;
+            e.wind = 1;
+        }
+        e.side = SIDE_NONE;
+        sweep.edges.push_back(e);
+    }
+    return true;
+}
+
+void PolygonUnion::SortActive(Sweep& sweep, size_t firstNew)
+{
+    const std::vector<Edge>& edges = sweep.edges;
+    // Coincident edges put the entering one first, so touching outlines leave no seam
+    auto less = [&edges](uint32_t ia, uint32_t ib) {
+        const Edge& a = edges[ia];
+        const Edge& b = edges[ib];
+        if (a.curX != b.curX) {
+            return a.curX < b.curX;
+        }
+        if (a.topX != b.topX) {
+            return a.topX < b.topX;
+        }
+        return a.wind > b.wind;
+    };
+
+    std::vector<uint32_t>& active = sweep.active;
+    std::sort(active.begin() + firstNew, active.end(), less);
+    std::inplace_merge(active.begin(), active.begin() + firstNew, active.end(), less);
+
+    // Edges that met on the scanline may have to swap to follow their order above it
+    for (size_t i = 1; i < active.size(); i++) {
+        uint32_t id = active[i];
+        size_t j = i;
+        while (j > 0 && less(id, active[j - 1])) {
+            active[j] = active[j - 1];
+            j--;
+        }
+        active[j] = id;
+    }
+
+    for (size_t i = 0; i < active.size(); i++) {
+        sweep.position[active[i]] = (uint32_t)i;
+    }
+}
+
+void PolygonUnion::SetSide(Sweep& sweep, Edge& e, EdgeSide side, double x, double y)
+{
+    if (e.side == side) {
+        return;
+    }
+
+    // Left sides run down and right sides up, the union boundary ends up counter-clockwise
+    if (e.side != SIDE_NONE && (x != e.sx || y != e.sy)) {
+        if (e.side == SIDE_LEFT) {
+            sweep.segments.push_back({{x, y}, {e.sx, e.sy}});
+        } else {
+            sweep.segments.push_back({{e.sx, e.sy}, {x, y}});
+        }
+    }
+    e.side = side;
+    e.sx = x;
+    e.sy = y;
+}
+
+PolygonUnion::EdgeSide PolygonUnion::SideOf(int windLeft, int wind)
+{
+    // Positive winding is covered, so loops a self overlapping outline turns backwards stay empty
+    if (windLeft <= 0 && windLeft + wind > 0) {
+        return SIDE_LEFT;
+    }
+    if (windLeft > 0 && windLeft + wind <= 0) {
+        return SIDE_RIGHT;
+    }
+    return SIDE_NONE;
+}
+
+void PolygonUnion::UpdateSides(Sweep& sweep, double y)
+{
+    int winding = 0;
+    for (uint32_t id : sweep.active) {
+        Edge& e = sweep.edges[id];
+        e.windLeft = winding;
+        SetSide(sweep, e, SideOf(e.windLeft, e.wind), e.curX, y);
+        winding += e.wind;
+    }
+}
+
+void PolygonUnion::CollectIntervals(const Sweep& sweep, std::vector<Interval>& intervals)
+{
+    intervals.clear();
+    for (uint32_t id : sweep.active) {
+        const Edge& e = sweep.edges[id];
+        if (e.side == SIDE_LEFT) {
+            intervals.push_back({e.curX, e.curX});
+        } else if (e.side == SIDE_RIGHT) {
+            intervals.back().second = e.curX;
+        }
+    }
+}
+
+void PolygonUnion::AddHorizontals(Sweep& sweep, const std::vector<Interval>& below, const std::vector<Interval>& above, double y)
+{
+    if (below.empty() && above.empty()) {
+        return;
+    }
+
+    // Coverage changes along the scanline, (x, change below, change above)
+    struct Change{
+        double x;
+        int below;
+        int above;
+    };
+    std::vector<Change> changes;
+    changes.reserve((below.size() + above.size()) * 2);
+    for (const Interval& i : below) {
+        changes.push_back({i.first, 1, 0});
+        changes.push_back({i.second, -1, 0});
+    }
+    for (const Interval& i : above) {
+        changes.push_back({i.first, 0, 1});
+        changes.push_back({i.second, 0, -1});
+    }
+    std::sort(changes.begin(), changes.end(), [](const Change& a, const Change& b) { return a.x < b.x; });
+
+    // Covered only below is the top of the region and runs right to left,
+    // covered only above is a bottom and runs left to right
+    int coveredBelow = 0, coveredAbove = 0;
+    int runType = 0;
+    double runStart = 0.0;
+    size_t i = 0;
+    while (i < changes.size()) {
+        double x = changes[i].x;
+        while (i < changes.size() && changes[i].x == x) {
+            coveredBelow += changes[i].below;
+            coveredAbove += changes[i].above;
+            i++;
+        }
+
+        int type = 0;
+        if (coveredBelow > 0 && coveredAbove == 0) {
+            type = 1;
+        } else if (coveredAbove > 0 && coveredBelow == 0) {
+            type = 2;
+        }
+        if (type == runType) {
+            continue;
+        }
+        if (runType == 1) {
+            sweep.segments.push_back({{x, y}, {runStart, y}});
+        } else if (runType == 2) {
+            sweep.segments.push_back({{runStart, y}, {x, y}});
+        }
+        runType = type;
+        runStart = x;
+    }
+}
+
+bool PolygonUnion::ProcessCrossings(Sweep& sweep, double y, double nextY)
+{
+    std::vector<Edge>& edges = sweep.edges;
+    std::vector<uint32_t>& order = sweep.scratch;
+    std::vector<Crossing>& crossings = sweep.crossings;
+    order = sweep.active;
+    crossings.clear();
+
+    // Every swap of the insertion sort on top x is one pair crossing inside the scanbeam
+    for (size_t i = 1; i < order.size(); i++) {
+        size_t j = i;
+        while (j > 0 && edges[order[j - 1]].topX > edges[order[j]].topX) {
+            const Edge& a = edges[order[j - 1]];
+            const Edge& b = edges[order[j]];
+            double rx = a.x1 - a.x0, ry = a.y1 - a.y0;
+            double qx = b.x1 - b.x0, qy = b.y1 - b.y0;
+            double denom = rx * qy - ry * qx;
+            if (denom == 0.0) {
+                return false;
+            }
+            double t = ((b.x0 - a.x0) * qy - (b.y0 - a.y0) * qx) / denom;
+            double cy = std::clamp(a.y0 + t * ry, y, nextY);
+            crossings.push_back({order[j - 1], order[j], a.x0 + t * rx, cy});
+            std::swap(order[j - 1], order[j]);
+            j--;
+        }
+    }
+    if (crossings.empty()) {
+        return true;
+    }
+
+    std::sort(crossings.begin(), crossings.end(), [](const Crossing& a, const Crossing& b) {
+        return a.y != b.y ? a.y < b.y : a.x < b.x;
+    });
+
+    std::vector<uint32_t>& position = sweep.position;
+    for (size_t i = 0; i < crossings.size(); i++) {
+        // Rounding can order near concurrent crossings wrongly, take the next one that is adjacent
+        if (position[crossings[i].left] + 1 != position[crossings[i].right]) {
+            size_t j = i + 1;
+            while (j < crossings.size() && position[crossings[j].left] + 1 != position[crossings[j].right]) {
+                j++;
+            }
+            if (j == crossings.size()) {
+                return false;
+            }
+            std::swap(crossings[i], crossings[j]);
+        }
+
+        const Crossing& c = crossings[i];
+        Edge& left = edges[c.left];
+        Edge& right = edges[c.right];
+        uint32_t p = position[c.left];
+        std::swap(sweep.active[p], sweep.active[p + 1]);
+        position[c.right] = p;
+        position[c.left] = p + 1;
+
+        // Only the swapped pair sees a different winding to its left
+        right.windLeft = left.windLeft;
+        left.windLeft = right.windLeft + right.wind;
+        SetSide(sweep, right, SideOf(right.windLeft, right.wind), c.x, c.y);
+        SetSide(sweep, left, SideOf(left.windLeft, left.wind), c.x, c.y);
+    }
+    return true;
+}
+
+bool PolygonUnion::BuildPolygons(const std::vector<Segment>& segments, std::vector<UnionPolygon>& result)
+{
+    std::vector<uint32_t> byStart(segments.size());
+    for (size_t i = 0; i < segments.size(); i++) {
+        byStart[i] = (uint32_t)i;
+    }
+    auto startLess = [&segments](uint32_t a, uint32_t b) {
+        const UnionPoint& pa = segments[a].start;
+        const UnionPoint& pb = segments[b].start;
+        return pa.x != pb.x ? pa.x < pb.x : pa.y < pb.y;
+    };
+    std::sort(byStart.begin(), byStart.end(), startLess);
+
+    std::vector<bool> used(segments.size(), false);
+    std::vector<UnionRing> outers;
+    std::vector<UnionRing> holes;
+
+    for (uint32_t first : byStart) {
+        if (used[first]) {
+            continue;
+        }
+
+        UnionRing ring;
+        uint32_t current = first;
+        while (true) {
+            used[current] = true;
+            const Segment& s = segments[current];
+            ring.push_back(s.start);
+            if (SamePoint(s.end, segments[first].start)) {
+                break;
+            }
+
+            // Where boundaries touch in a point, take the sharpest left turn so each ring stays simple
+            UnionPoint key = s.end;
+            auto lo = std::lower_bound(byStart.begin(), byStart.end(), key, [&segments](uint32_t a, const UnionPoint& p) {
+                const UnionPoint& pa = segments[a].start;
+                return pa.x != p.x ? pa.x < p.x : pa.y < p.y;
+            });
+
+            double dx = s.end.x - s.start.x, dy = s.end.y - s.start.y;
+            int64_t next = -1;
+            double bestTurn = 0.0;
+            for (auto it = lo; it != byStart.end() && SamePoint(segments[*it].start, key); ++it) {
+                if (used[*it]) {
+                    continue;
+                }
+                const Segment& n = segments[*it];
+                double nx = n.end.x - n.start.x, ny = n.end.y - n.start.y;
+                double turn = std::atan2(dx * ny - dy * nx, dx * nx + dy * ny);
+                if (next < 0 || turn > bestTurn) {
+                    next = *it;
+                    bestTurn = turn;
+                }
+            }
+            if (next < 0) {
+                return false;
+            }
+            current = (uint32_t)next;
+        }
+
+        RemoveCollinear(ring);
+        if (ring.size() < 3) {
+            continue;
+        }
+        double area = RingArea(ring);
+        if (area > UNION_MIN_AREA) {
+            outers.push_back(std::move(ring));
+        } else if (area < -UNION_MIN_AREA) {
+            holes.push_back(std::move(ring));
+        }
+    }
+
+    std::vector<Bounds> bounds(outers.size());
+    std::vector<double> areas(outers.size());
+    for (size_t i = 0; i < outers.size(); i++) {
+        bounds[i] = GetBounds(outers[i]);
+        areas[i] = RingArea(outers[i]);
+    }
+
+    result.clear();
+    result.resize(outers.size());
+    for (size_t i = 0; i < outers.size(); i++) {
+        result[i].outer = std::move(outers[i]);
+    }
+
+    for (UnionRing& hole : holes) {
+        // The middle of the longest edge lies clear of the touching points a hole may share with its outer
+        size_t longest = 0;
+        double longestLength = -1.0;
+        for (size_t i = 0; i < hole.size(); i++) {
+            const UnionPoint& a = hole[i];
+            const UnionPoint& b = hole[(i + 1) % hole.size()];
+            double length = (b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y);
+            if (length > longestLength) {
+                longest = i;
+                longestLength = length;
+            }
+        }
+        const UnionPoint& a = hole[longest];
+        const UnionPoint& b = hole[(longest + 1) % hole.size()];
+        UnionPoint probe = {(a.x + b.x) * 0.5, (a.y + b.y) * 0.5};
+
+        // The innermost outer around the hole owns it
+        int64_t owner = -1;
+        for (size_t i = 0; i < result.size(); i++) {
+            if (!bounds[i].Contains(probe)) {
+                continue;
+            }
+            if ((owner < 0 || areas[i] < areas[owner]) && ContainsPoint(result[i].outer, probe)) {
+                owner = (int64_t)i;
+            }
+        }
+        if (owner < 0) {
+            return false;
+        }
+        result[owner].holes.push_back(std::move(hole));
+    }
+
+    // Back from grid units to mm
+    double inverseScale = 1.0 / UNION_GRID_SCALE;
+    for (UnionPolygon& polygon : result) {
+        for (UnionPoint& p : polygon.outer) {
+            p.x *= inverseScale;
+            p.y *= inverseScale;
+        }
+        for (UnionRing& hole : polygon.holes) {
+            for (UnionPoint& p : hole) {
+                p.x *= inverseScale;
+                p.y *= inverseScale;
+            }
+        }
+    }
+    return true;
+}
+
+bool PolygonUnion::Union(const std::vector<UnionRing>& rings, std::vector<UnionPolygon>& result)
+{
+    Sweep sweep;
+    for (const UnionRing& ring : rings) {
+        if (!AddRing(sweep, ring, false)) {
+            return false;
+        }
+    }
+    return Run(sweep, result);
+}
+
+bool PolygonUnion::Union(const std::vector<UnionPolygon>& polygons, std::vector<UnionPolygon>& result)
+{
+    Sweep sweep;
+    for (const UnionPolygon& polygon : polygons) {
+        if (!AddRing(sweep, polygon.outer, false)) {
+            return false;
+        }
+        for (const UnionRing& hole : polygon.holes) {
+            if (!AddRing(sweep, hole, true)) {
+                return false;
+            }
+        }
+    }
+    return Run(sweep, result);
+}
+
+PolygonUnion::Bounds PolygonUnion::GetBounds(const UnionRing& ring)
+{
+    Bounds b = {ring[0].x, ring[0].y, ring[0].x, ring[0].y};
+    for (const UnionPoint& p : ring) {
+        b.minX = std::min(b.minX, p.x);
+        b.minY = std::min(b.minY, p.y);
+        b.maxX = std::max(b.maxX, p.x);
+        b.maxY = std::max(b.maxY, p.y);
+    }
+    return b;
+}
+
+bool PolygonUnion::Merge(std::vector<UnionPolygon>& a, std::vector<UnionPolygon>& b, std::vector<UnionPolygon>& result)
+{
+    std::vector<Bounds> boundsA(a.size());
+    std::vector<Bounds> boundsB(b.size());
+    Bounds extentA = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+    Bounds extentB = extentA;
+    for (size_t i = 0; i < a.size(); i++) {
+        boundsA[i] = GetBounds(a[i].outer);
+        extentA = extentA.Join(boundsA[i]);
+    }
+    for (size_t i = 0; i < b.size(); i++) {
+        boundsB[i] = GetBounds(b[i].outer);
+        extentB = extentB.Join(boundsB[i]);
+    }
+
+    // Polygons clear of the other side's extent cannot change, only the seam goes through the sweep
+    std::vector<UnionPolygon> seam;
+    std::vector<UnionPolygon> kept;
+    for (size_t i = 0; i < a.size(); i++) {
+        (boundsA[i].Overlaps(extentB) ? seam : kept).push_back(std::move(a[i]));
+    }
+    for (size_t i = 0; i < b.size(); i++) {
+        (boundsB[i].Overlaps(extentA) ? seam : kept).push_back(std::move(b[i]));
+    }
+    a.clear();
+    b.clear();
+
+    if (!Union(seam, result)) {
+        return false;
+    }
+    for (auto& polygon : kept) {
+        result.push_back(std::move(polygon));
+    }
+    return true;
+}
+
+bool PolygonUnion::Run(Sweep& sweep, std::vector<UnionPolygon>& result)
+{
+    result.clear();
+    std::vector<Edge>& edges = sweep.edges;
+    if (edges.empty()) {
+        return true;
+    }
+
+    std::vector<uint32_t> byBottom(edges.size());
+    std::vector<double> scanlines;
+    scanlines.reserve(edges.size() * 2);
+    for (size_t i = 0; i < edges.size(); i++) {
+        byBottom[i] = (uint32_t)i;
+        scanlines.push_back(edges[i].y0);
+        scanlines.push_back(edges[i].y1);
+    }
+    std::sort(byBottom.begin(), byBottom.end(), [&edges](uint32_t a, uint32_t b) { return edges[a].y0 < edges[b].y0; });
+    std::sort(scanlines.begin(), scanlines.end());
+    scanlines.erase(std::unique(scanlines.begin(), scanlines.end()), scanlines.end());
+
+    sweep.position.resize(edges.size());
+    std::vector<Interval> below;
+    std::vector<Interval> above;
+    size_t nextEdge = 0;
+
+    for (size_t k = 0; k < scanlines.size(); k++) {
+        double y = scanlines[k];
+        double nextY = (k + 1 < scanlines.size()) ? scanlines[k + 1] : y;
+
+        CollectIntervals(sweep, below);
+
+        // Retire edges ending on this scanline
+        size_t kept = 0;
+        for (uint32_t id : sweep.active) {
+            Edge& e = edges[id];
+            if (e.y1 == y) {
+                SetSide(sweep, e, SIDE_NONE, e.x1, y);
+            } else {
+                sweep.active[kept++] = id;
+            }
+        }
+        sweep.active.resize(kept);
+
+        size_t firstNew = sweep.active.size();
+        while (nextEdge < byBottom.size() && edges[byBottom[nextEdge]].y0 == y) {
+            uint32_t id = byBottom[nextEdge++];
+            edges[id].curX = edges[id].x0;
+            sweep.active.push_back(id);
+        }
+        for (uint32_t id : sweep.active) {
+            edges[id].topX = XAt(edges[id], nextY);
+        }
+
+        SortActive(sweep, firstNew);
+        UpdateSides(sweep, y);
+
+        CollectIntervals(sweep, above);
+        AddHorizontals(sweep, below, above, y);
+
+        if (!ProcessCrossings(sweep, y, nextY)) {
+            return false;
+        }
+        for (uint32_t id : sweep.active) {
+            edges[id].curX = edges[id].topX;
+        }
+    }
+
+    return BuildPolygons(sweep.segments, result);
+}
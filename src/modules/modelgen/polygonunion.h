@@ -0,0 +1,118 @@
+#pragma once
+#include <cstddef>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Snap grid of the scanline union, units per mm (one micron)
+#define UNION_GRID_SCALE 1000.0
+// Snapped coordinates beyond this (grid units) would overflow the exact products
+#define UNION_MAX_COORD 16777216.0
+
+struct UnionPoint{
+    double x;
+    double y;
+};
+
+using UnionRing = std::vector<UnionPoint>;
+
+// Outer boundary is counter-clockwise, holes are clockwise
+struct UnionPolygon{
+    UnionRing outer;
+    std::vector<UnionRing> holes;
+};
+
+// Vatti style scanline union on integer coordinates. Ring vertices are
+// snapped to the micron grid, the active edge list is swept bottom to top and
+// boundary segments are emitted wherever an edge starts or stops bounding
+// the positive winding region. Edge crossings inside a scanbeam are found by
+// insertion sorting the edges on their top x and are handled in y order, the
+// crossing point is shared by both edges so the segments link up exactly.
+class PolygonUnion{
+public:
+    // Union of the rings, each oriented by its net area so rings may overlap
+    // themselves (only their positive winding part is filled). Returns
+    // false on a configuration the sweep could not resolve (crossings that
+    // never become adjacent, boundary chains that do not close, holes without
+    // an outer boundary), result is unusable then.
+    static bool Union(const std::vector<UnionRing>& rings, std::vector<UnionPolygon>& result);
+    // Union of polygons with holes, outer boundaries and holes keep their role
+    static bool Union(const std::vector<UnionPolygon>& polygons, std::vector<UnionPolygon>& result);
+    // Union of two already merged sets, polygons that cannot touch the other
+    // set skip the sweep. Consumes a and b.
+    static bool Merge(std::vector<UnionPolygon>& a, std::vector<UnionPolygon>& b, std::vector<UnionPolygon>& result);
+
+private:
+    enum EdgeSide
+    {
+        SIDE_NONE = 0,
+        SIDE_LEFT = 1,
+        SIDE_RIGHT = 2
+    };
+
+    struct Edge{
+        // Bottom and top end point, grid units
+        double x0, y0, x1, y1;
+        // +1 for edges running down the ring, counter-clockwise outlines enter on the left
+        int wind;
+        int windLeft;
+        // x at the current scanline and at the top of the current scanbeam
+        double curX;
+        double topX;
+        EdgeSide side;
+        // Start of the boundary segment the edge currently carries
+        double sx, sy;
+    };
+
+    struct Segment{
+        UnionPoint start;
+        UnionPoint end;
+    };
+
+    struct Crossing{
+        uint32_t left;
+        uint32_t right;
+        double x;
+        double y;
+    };
+
+    struct Bounds{
+        double minX, minY, maxX, maxY;
+
+        Bounds Join(const Bounds& o) const {
+            return {std::min(minX, o.minX), std::min(minY, o.minY), std::max(maxX, o.maxX), std::max(maxY, o.maxY)};
+        }
+        bool Overlaps(const Bounds& o) const {
+            return minX <= o.maxX && o.minX <= maxX && minY <= o.maxY && o.minY <= maxY;
+        }
+        bool Contains(const UnionPoint& p) const {
+            return p.x >= minX && p.x <= maxX && p.y >= minY && p.y <= maxY;
+        }
+    };
+
+    // Covered x range on a scanline
+    using Interval = std::pair<double, double>;
+
+    struct Sweep{
+        std::vector<Edge> edges;
+        std::vector<uint32_t> active;
+        std::vector<uint32_t> position;
+        std::vector<uint32_t> scratch;
+        std::vector<Crossing> crossings;
+        std::vector<Segment> segments;
+    };
+
+    static bool AddRing(Sweep& sweep, const UnionRing& ring, bool clockwise);
+    static bool Run(Sweep& sweep, std::vector<UnionPolygon>& result);
+    static Bounds GetBounds(const UnionRing& ring);
+    static double XAt(const Edge& e, double y);
+    static void SortActive(Sweep& sweep, size_t firstNew);
+    static EdgeSide SideOf(int windLeft, int wind);
+    static void SetSide(Sweep& sweep, Edge& e, EdgeSide side, double x, double y);
+    static void UpdateSides(Sweep& sweep, double y);
+    static void CollectIntervals(const Sweep& sweep, std::vector<Interval>& intervals);
+    static void AddHorizontals(Sweep& sweep, const std::vector<Interval>& below, const std::vector<Interval>& above, double y);
+    static bool ProcessCrossings(Sweep& sweep, double y, double nextY);
+    static bool BuildPolygons(const std::vector<Segment>& segments, std::vector<UnionPolygon>& result);
+};
@@ -1,5 +1,7 @@
 #include "project.h"
 
+#include <chrono>
+
 #include "../../core/renderer/object.h"
 
 #include "../file/file.h"
@@ -12,8 +14,18 @@
 #include "../freefem/freefem.h"
 #include "../freefem/freefemscript.h"
 
+// Toolpaths of the layers a followed file has completed so far
+struct GCodeFollowPreview{
+    std::vector<GCodePoint> points;
+    std::vector<GCodePath> paths;
+    size_t layers = 0;
+    bool changed = false;
+    std::chrono::steady_clock::time_point uploaded;
+};
+
 Project::Project(){
     gcodeModule = std::make_unique<GCodeModule>();
+    followPreview = std::make_unique<GCodeFollowPreview>();
     layerMapper = std::make_unique<LayerMapper>();
     tetrahedralMesher = std::make_unique<TetrahedralMesher>();
     freefemScript = std::make_unique<FreeFemScript>();
@@ -51,21 +63,159 @@ std::string Project::GetFilenameWithoutExtension(){
     return filenameWithoutExt;
 }
 
+bool Project::BeginGCodeTask(){
+    if(isFollowingGCode) {
+        printf("A GCode file is being followed. Stop following first.\n");
+        return false;
+    }
+    if(isShellMeshRunning || isLayerPreviewRunning) {
+        printf("A mesh is being generated from the current GCode. Wait for it first.\n");
+        return false;
+    }
+    bool idle = false;
+    if(!isGCodeTaskRunning.compare_exchange_strong(idle, true)) {
+        printf("Another GCode task is running. Wait for it first.\n");
+        return false;
+    }
+    return true;
+}
+
 void Project::LoadGCode(FilePath* filepath){
-    gcodeModule->OpenFile(filepath);
-    gcodeModule->ExtractPointsAndPaths();
-    isGCodeFileLoaded = true;
+    if(!BeginGCodeTask()) {
+        return;
+    }
+    gcodeModule->nozzleDiameter = layerMapper->nozzle.diameter;
+    // A failed or partial load may leave the module half replaced
+    isGCodeFileLoaded = gcodeModule->LoadFile(filepath);
+    isGCodeTaskRunning = false;
+}
+
+void Project::BuildGCodeLayerIndex(){
+    if(!BeginGCodeTask()) {
+        return;
+    }
+    if(gcodeModule->currentFile) {
+        gcodeModule->BuildLayerIndex(gcodeModule->currentFile.get());
+    } else {
+        printf("No GCode file loaded.\n");
+    }
+    isGCodeTaskRunning = false;
+}
+
+void Project::LoadGCodeLayer(size_t layer){
+    if(!BeginGCodeTask()) {
+        return;
+    }
+    gcodeModule->LoadLayer(layer);
+    isGCodeTaskRunning = false;
+}
+
+void Project::BenchmarkGCodeLexer(){
+    if(!BeginGCodeTask()) {
+        return;
+    }
+    gcodeModule->BenchmarkLexer();
+    isGCodeTaskRunning = false;
+}
+
+bool Project::IsGCodeTaskRunning(){
+    return isGCodeTaskRunning;
+}
+
+void Project::FollowGCode(FilePath* filepath, const std::atomic<bool>& stop){
+    if(isGCodeTaskRunning) {
+        printf("A GCode task is running. Wait for it before following a file.\n");
+        return;
+    }
+    bool idle = false;
+    if(!isFollowingGCode.compare_exchange_strong(idle, true)) {
+        printf("Already following a GCode file.\n");
+        return;
+    }
+
+    // The module grows on this thread, it is handed out again once following ends
+    isGCodeFileLoaded = false;
+    {
+        std::lock_guard<std::mutex> lock(followPreviewMutex);
+        *followPreview = GCodeFollowPreview();
+    }
+
+    gcodeModule->nozzleDiameter = layerMapper->nozzle.diameter;
+    gcodeModule->FollowFile(filepath, stop, [this](size_t layer) {
+        PublishFollowedLayer(layer);
+    });
+
+    // A rejected file leaves the previous one in place, a failed read keeps what was parsed
+    isGCodeFileLoaded = gcodeModule->currentFile != nullptr;
+    isFollowingGCode = false;
+}
+
+void Project::PublishFollowedLayer(size_t layer){
+    const GCodeModule& gcode = *gcodeModule;
+    const GCodeLayerBoundary& boundary = gcode.layerBoundaries[layer];
+    size_t endPath = layer + 1 < gcode.layerBoundaries.size() ? gcode.layerBoundaries[layer + 1].firstPath : gcode.paths.size();
+
+    std::lock_guard<std::mutex> lock(followPreviewMutex);
+    GCodeFollowPreview& preview = *followPreview;
+    // Layers restart from 0 when the file was truncated and is read again
+    if(layer < preview.layers) {
+        preview = GCodeFollowPreview();
+    }
+
+    // Points and paths only ever get appended, copy what the new layers added
+    size_t endPoint = preview.points.size();
+    for(size_t i = preview.paths.size(); i < endPath; i++) {
+        endPoint = std::max<size_t>(endPoint, std::max(gcode.paths[i].start, gcode.paths[i].end));
+    }
+    preview.points.insert(preview.points.end(), gcode.points.begin() + preview.points.size(), gcode.points.begin() + endPoint);
+    preview.paths.insert(preview.paths.end(), gcode.paths.begin() + preview.paths.size(), gcode.paths.begin() + endPath);
+    preview.layers = layer + 1;
+    preview.changed = true;
+
+    printf("Layer %zu complete at Z=%.3f\n", layer, boundary.z);
+}
+
+bool Project::IsFollowingGCode(){
+    return isFollowingGCode;
+}
+
+void Project::UpdateFollowPreview(){
+    std::lock_guard<std::mutex> lock(followPreviewMutex);
+    if(!followPreview->changed) {
+        return;
+    }
+    // Every upload covers all layers so far, they are spaced out so a long
+    // print does not re-upload its whole toolpath each layer
+    auto now = std::chrono::steady_clock::now();
+    if(now - followPreview->uploaded < std::chrono::milliseconds(FOLLOW_PREVIEW_INTERVAL_MS)) {
+        return;
+    }
+    followPreview->changed = false;
+    followPreview->uploaded = now;
+
+    ReplaceGCodeRenderObject(GCodeModule::PathsToRenderObject(followPreview->points, followPreview->paths, gcodeModule->quantizeRender));
+}
+
+GCodeModule& Project::GetGCodeModule(){
+    return *gcodeModule;
 }
 
 FilePath* Project::GetCurrentGCodeFilePath(){
     return gcodeModule->currentFile.get();
 }
 
-void Project::GenerateRenderObjectFromGCode(){
-    GCodeRenderObject = std::make_unique<Object>(gcodeModule->ConvertPathToRenderObject());
+void Project::ReplaceGCodeRenderObject(Object object){
+    if(GCodeRenderObject) {
+        GCodeRenderObject->Release();
+    }
+    GCodeRenderObject = std::make_unique<Object>(std::move(object));
     isGCodeRenderObjectGenerated = true;
 }
 
+void Project::GenerateRenderObjectFromGCode(){
+    ReplaceGCodeRenderObject(gcodeModule->ConvertPathToRenderObject());
+}
+
 bool Project::HasGCodeRenderObject(){
     return isGCodeRenderObjectGenerated;
 }
@@ -79,28 +229,94 @@ bool Project::isProjectLoaded(){
 }
 
 void Project::ExtractLayers(){
-    std::vector<GCodeLayer> layers = gcodeModule->ExtractLayers();
-
-    printf("Extracted %zu layers from GCode.\n", layers.size());
+    // The module reports the layer count when it extracts them
+    std::lock_guard<std::mutex> lock(extractLayersMutex);
+    gcodeModule->ExtractLayers();
 }
 
 void Project::GenerateShellMesh(){
-    std::vector<GCodeLayer> layers = gcodeModule->ExtractLayers();
-    
-    //layerMapper.CreateRenderObjectFromMesh(layers);
+    if(isGCodeTaskRunning) {
+        printf("The GCode module is busy. Wait for it before generating a mesh.\n");
+        return;
+    }
+    bool idle = false;
+    if(!isShellMeshRunning.compare_exchange_strong(idle, true)) {
+        printf("A 3D mesh is already being generated.\n");
+        return;
+    }
 
-    shellMesh = std::make_unique<Mesh>(
-        layerMapper->GenerateMesh(layers)
-    );
+    const std::vector<GCodeLayer>* layers;
+    {
+        std::lock_guard<std::mutex> lock(extractLayersMutex);
+        layers = &gcodeModule->ExtractLayers();
+    }
 
-    MeshRenderObject = std::make_unique<Object>(
-        ModelgenHelper::MeshToRenderObject(*shellMesh)
+    std::unique_ptr<Mesh> mesh = std::make_unique<Mesh>(
+        layerMapper->GenerateMesh(*layers, gcodeModule->points, gcodeModule->paths)
     );
-    isMeshGenerated = true;
+    {
+        std::lock_guard<std::mutex> lock(generatedMeshMutex);
+        pendingShellMesh = std::move(mesh);
+    }
+    isShellMeshRunning = false;
 
     printf("Generated 3D Mesh from Layers.\n");
 }
 
+void Project::GenerateLayerPreview(size_t layer){
+    if(isGCodeTaskRunning) {
+        printf("The GCode module is busy. Wait for it before generating a mesh.\n");
+        return;
+    }
+    bool idle = false;
+    if(!isLayerPreviewRunning.compare_exchange_strong(idle, true)) {
+        printf("A layer preview is already being generated.\n");
+        return;
+    }
+
+    const std::vector<GCodeLayer>* layers;
+    {
+        std::lock_guard<std::mutex> lock(extractLayersMutex);
+        layers = &gcodeModule->ExtractLayers();
+    }
+
+    if(layer < layers->size()) {
+        std::unique_ptr<Mesh> mesh = std::make_unique<Mesh>(
+            layerMapper->GenerateLayerMesh((*layers)[layer], gcodeModule->points, gcodeModule->paths)
+        );
+        std::lock_guard<std::mutex> lock(generatedMeshMutex);
+        pendingLayerPreview = std::move(mesh);
+    } else {
+        printf("Layer %zu does not exist, the GCode has %zu layers.\n", layer, layers->size());
+    }
+    isLayerPreviewRunning = false;
+}
+
+bool Project::IsGeneratingMesh(){
+    return isShellMeshRunning;
+}
+
+bool Project::IsGeneratingLayerPreview(){
+    return isLayerPreviewRunning;
+}
+
+void Project::UpdateMeshRenderObjects(){
+    std::lock_guard<std::mutex> lock(generatedMeshMutex);
+    if(pendingShellMesh) {
+        shellMesh = std::move(pendingShellMesh);
+        MeshRenderObject = std::make_unique<Object>(
+            ModelgenHelper::MeshToRenderObject(*shellMesh)
+        );
+        isMeshGenerated = true;
+    }
+    if(pendingLayerPreview) {
+        LayerPreviewRenderObject = std::make_unique<Object>(
+            ModelgenHelper::MeshToRenderObject(*pendingLayerPreview)
+        );
+        pendingLayerPreview.reset();
+    }
+}
+
 bool Project::HasShellMeshGenerated(){
     return isMeshGenerated;
 }
@@ -109,6 +325,14 @@ std::unique_ptr<Object>& Project::GetMeshRenderObject(){
     return MeshRenderObject;
 }
 
+bool Project::HasLayerPreview(){
+    return LayerPreviewRenderObject != nullptr;
+}
+
+std::unique_ptr<Object>& Project::GetLayerPreviewRenderObject(){
+    return LayerPreviewRenderObject;
+}
+
 LayerMapper& Project::GetLayerMapper(){
     return *layerMapper;
 }
@@ -1,10 +1,13 @@
 #pragma once
 #include <memory>
+#include <atomic>
+#include <mutex>
 #include <string>
 
 #include "../modelgen/modelgentypes.h"
 
 class GCodeModule;
+struct GCodeFollowPreview;
 class LayerMapper;
 struct FilePath;
 
@@ -20,15 +23,37 @@ class Object;
 
 class Project {
     std::unique_ptr<GCodeModule> gcodeModule;
-    bool isGCodeFileLoaded = false;
+    std::atomic<bool> isGCodeFileLoaded = false;
+    // Loading, layer indexing and benchmarking run on worker threads, one at a
+    // time and never next to following or mesh generation
+    std::atomic<bool> isGCodeTaskRunning = false;
+    bool BeginGCodeTask();
     bool isGCodeRenderObjectGenerated = false;
     std::unique_ptr<Object> GCodeRenderObject;
+    // Frees the GL objects of the current one first, UI thread only
+    void ReplaceGCodeRenderObject(Object object);
+
+    // While a file is followed only the following thread touches gcodeModule,
+    // completed layers reach the UI through a copy guarded by the mutex
+    std::atomic<bool> isFollowingGCode = false;
+    std::mutex followPreviewMutex;
+    std::unique_ptr<GCodeFollowPreview> followPreview;
+    void PublishFollowedLayer(size_t layer);
 
     std::unique_ptr<LayerMapper> layerMapper;
     bool isMeshGenerated = false;
     std::unique_ptr<Mesh> shellMesh;
     std::unique_ptr<Object> MeshRenderObject;
 
+    // Meshes are generated on worker threads and uploaded by the UI thread
+    std::atomic<bool> isShellMeshRunning = false;
+    std::atomic<bool> isLayerPreviewRunning = false;
+    std::mutex generatedMeshMutex;
+    std::mutex extractLayersMutex;
+    std::unique_ptr<Mesh> pendingShellMesh;
+    std::unique_ptr<Mesh> pendingLayerPreview;
+    std::unique_ptr<Object> LayerPreviewRenderObject;
+
     std::unique_ptr<TetrahedralMesher> tetrahedralMesher;
     bool isTetrahedralMeshGenerated = false;
     std::unique_ptr<TetrahedralMesherResult> tetrahedralMeshResult;
@@ -47,15 +72,32 @@ public:
     std::string GetFilenameWithoutExtension();
 
     void LoadGCode(FilePath* filepath);
+    void BuildGCodeLayerIndex();
+    void LoadGCodeLayer(size_t layer);
+    void BenchmarkGCodeLexer();
+    bool IsGCodeTaskRunning();
+    void FollowGCode(FilePath* filepath, const std::atomic<bool>& stop);
+    bool IsFollowingGCode();
+    // Uploads the layers completed since the last call, UI thread only
+    void UpdateFollowPreview();
+    GCodeModule& GetGCodeModule();
     FilePath* GetCurrentGCodeFilePath();
     void GenerateRenderObjectFromGCode();
     bool HasGCodeRenderObject();
     std::unique_ptr<Object>& GetGCodeRenderObject();
 
     void ExtractLayers();
+    // Both run on a worker thread, the result shows up after UpdateMeshRenderObjects
     void GenerateShellMesh();
+    void GenerateLayerPreview(size_t layer);
+    bool IsGeneratingMesh();
+    bool IsGeneratingLayerPreview();
+    // Uploads meshes finished since the last call, UI thread only
+    void UpdateMeshRenderObjects();
     bool HasShellMeshGenerated();
     std::unique_ptr<Object>& GetMeshRenderObject();
+    bool HasLayerPreview();
+    std::unique_ptr<Object>& GetLayerPreviewRenderObject();
     LayerMapper& GetLayerMapper();
 
     void GenerateTetrahedralMesh();